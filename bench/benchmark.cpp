@@ -0,0 +1,517 @@
+/*
+
+Benchmark harness: times the multiplication algorithms over a sweep of sizes
+and element types, and reports the results as a table, JSON, or CSV.
+
+------------------------------------------------------------------------
+
+Method:
+For each element type, shape, and algorithm, the harness runs the multiply
+<WARMUP> times untimed (to fault in pages, grow the packing buffers, and
+start the thread pool), and then <REPEATS> times timed, one multiply per
+measurement.  Each measurement includes the allocation of the result, as a
+caller of the algorithm would see it.
+
+It reports:
+* the median and minimum time
+* GFLOP/s: 2 m k n / (median time), the rate of the classical algorithm,
+  even for Strassen-like algorithms (which do fewer operations), so that all
+  algorithms are compared on the same scale
+* effective bandwidth: (m k + k n + m n) * sizeof(T) / (median time), i.e.
+  the compulsory traffic of reading A and B and writing C, once each
+* the peak memory of one multiply (C, and any workspaces and temporaries),
+  its number of allocations, and the bytes it copied between matrices, from
+  one more, untimed, run with memory accounting on (see allocation.h)
+
+------------------------------------------------------------------------
+
+Baselines:
+With --baseline, the harness reads a CSV file written by an earlier run
+(with --format csv), and compares the median times of the runs they have in
+common.  If any is slower than its baseline by more than --threshold
+percent, it lists them, and exits with status 1.
+
+------------------------------------------------------------------------
+
+*/
+
+#include "matrix.h"
+#include "allocation.h"
+#include "bilinear.h"
+#include "simd.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+
+// settings, with their defaults
+struct Settings
+{
+    std::vector<string> shapes = { "256", "512", "1024" };
+    std::vector<string> types = { "int", "double" };
+    std::vector<string> algorithms = { "GEMM", "TB", "BB", "SB", "SW" };
+    U       warmup = 1;
+    U       repeats = 5;
+    U       max_TB_size = 1024;
+    string  format = "text";
+    string  output;
+    string  baseline;
+    double  threshold = 10;     // percent
+};
+
+static Settings settings;
+
+// The result of one benchmark.
+struct Result
+{
+    string  type;
+    string  algorithm;
+    U       m, k, n;
+    U       threads;
+    U       repeats;
+    double  median;     // seconds
+    double  min;        // seconds
+    double  gflops;
+    double  bandwidth;  // GB/s
+    U       peak_bytes;
+    U       allocations;
+    U       copied_bytes;
+
+    string get_key() const
+    {
+        return type + "," + algorithm + "," + to_string(m) + ","
+            + to_string(k) + "," + to_string(n) + "," + to_string(threads);
+    }
+};
+
+// ----------------------------------------------------
+
+static void Print_usage_and_exit(const char* argv[],
+    const char* error_msg = nullptr)
+{
+    if (error_msg != nullptr)
+        fprintf(stderr, "Error: %s\n\n", error_msg);
+
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "Options:\n"
+        "* -h = this help message\n"
+        "* --sizes <LIST> = comma-separated sizes: N for N x N x N, or MxKxN\n"
+        "  - defaults to 256,512,1024\n"
+        "* --types <LIST> = comma-separated element types: int, double\n"
+        "  - defaults to int,double\n"
+        "* --algorithms <LIST> = comma-separated algorithms:\n"
+        "  GEMM, TB, BB, SB, SW, BL (Strassen's tables), BB-Morton, SW-Morton\n"
+        "  - defaults to GEMM,TB,BB,SB,SW\n"
+        "* --warmup <N> = untimed runs before timing; defaults to %zu\n"
+        "* --repeats <N> = timed runs; defaults to %zu\n"
+        "* --max-TB-size <N> = skip TB when m * k * n > N**3; defaults to %zu\n"
+        "* --threads <N> = number of threads; defaults to %zu\n"
+        "* --leaf <N> = Strassen leaf size; defaults to %zu\n"
+        "* --format <text | json | csv> = output format; defaults to text\n"
+        "* --output <FILE> = write the results to FILE, instead of stdout\n"
+        "* --baseline <FILE> = compare with a CSV file from an earlier run\n"
+        "* --threshold <PERCENT> = slowdown that counts as a regression;\n"
+        "  defaults to %.0f\n",
+        argv[0], settings.warmup, settings.repeats, settings.max_TB_size,
+        get_num_threads(), get_SB_leaf_size(), settings.threshold);
+
+    exit (error_msg == nullptr);
+}
+
+static std::vector<string> split(const string& list, char separator)
+{
+    std::vector<string> items;
+    std::istringstream stream(list);
+    string item;
+
+    while (std::getline(stream, item, separator))
+        if (!item.empty())
+            items.push_back(item);
+
+    return items;
+}
+
+// Parse "N" or "MxKxN".  Return false if `shape` is neither.
+static bool parse_shape(const string& shape, U& m, U& k, U& n)
+{
+    auto dims = split(shape, 'x');
+
+    for (const auto& dim : dims)
+        if (dim.find_first_not_of("0123456789") != string::npos)
+            return false;
+
+    if (dims.size() == 1)
+    {
+        m = k = n = atol(dims[0].c_str());
+        return m > 0;
+    }
+
+    if (dims.size() == 3)
+    {
+        m = atol(dims[0].c_str());
+        k = atol(dims[1].c_str());
+        n = atol(dims[2].c_str());
+        return (m > 0) && (k > 0) && (n > 0);
+    }
+
+    return false;
+}
+
+static void Process_ARGV(int argc, const char* argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        string option = argv[i];
+
+        if (option == "-h")
+            Print_usage_and_exit(argv);
+
+        if (i + 1 >= argc)
+            Print_usage_and_exit(argv,
+                ("Missing value for " + option).c_str());
+
+        string value = argv[++i];
+        int number = atoi(value.c_str());
+
+        if (option == "--sizes")
+            settings.shapes = split(value, ',');
+        else if (option == "--types")
+            settings.types = split(value, ',');
+        else if (option == "--algorithms")
+            settings.algorithms = split(value, ',');
+        else if (option == "--warmup" && number >= 0)
+            settings.warmup = number;
+        else if (option == "--repeats" && number > 0)
+            settings.repeats = number;
+        else if (option == "--max-TB-size" && number >= 0)
+            settings.max_TB_size = number;
+        else if (option == "--threads" && number > 0)
+            set_num_threads(number);
+        else if (option == "--leaf" && number > 0)
+            set_SB_leaf_size(number);
+        else if (option == "--format" &&
+            (value == "text" || value == "json" || value == "csv"))
+            settings.format = value;
+        else if (option == "--output")
+            settings.output = value;
+        else if (option == "--baseline")
+            settings.baseline = value;
+        else if (option == "--threshold" && atof(value.c_str()) >= 0)
+            settings.threshold = atof(value.c_str());
+        else
+            Print_usage_and_exit(argv,
+                ("Incorrect option: " + option + " " + value).c_str());
+    }
+
+    U m, k, n;
+    for (const auto& shape : settings.shapes)
+        if (!parse_shape(shape, m, k, n))
+            Print_usage_and_exit(argv,
+                ("Incorrect size: " + shape).c_str());
+
+    for (const auto& type : settings.types)
+        if ((type != "int") && (type != "double"))
+            Print_usage_and_exit(argv,
+                ("Incorrect type: " + type).c_str());
+}
+
+// ----------------------------------------------------
+
+// Return the multiply function for `algorithm`, or an empty function if
+// there is no such algorithm.
+template<typename T>
+static std::function<Matrix<T>*(const Matrix<T>&, const Matrix<T>&)>
+    get_algorithm(const string& algorithm)
+{
+    using M = const Matrix<T>&;
+
+    if (algorithm == "GEMM")
+        return [](M A, M B) { return A.multiply(&B); };
+    if (algorithm == "TB")
+        return [](M A, M B) { return A.TB_multiply(&B); };
+    if (algorithm == "BB")
+        return [](M A, M B) { return A.BB_multiply(&B); };
+    if (algorithm == "SB")
+        return [](M A, M B) { return A.SB_multiply(&B); };
+    if (algorithm == "SW")
+        return [](M A, M B) { return A.SW_multiply(&B); };
+    if (algorithm == "BL")
+        return [](M A, M B)
+            { return A.BL_multiply(&B, { BilinearScheme::Strassen() }); };
+    if (algorithm == "BB-Morton")
+        return [](M A, M B) { return A.BB_multiply(&B, Layout::Morton); };
+    if (algorithm == "SW-Morton")
+        return [](M A, M B) { return A.SW_multiply(&B, Layout::Morton); };
+
+    return nullptr;
+}
+
+template<typename F>
+static double time_seconds(F f)
+{
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+template<typename T>
+static void run_benchmarks(const string& type, std::vector<Result>& results)
+{
+    for (const auto& shape : settings.shapes)
+    {
+        U m, k, n;
+        parse_shape(shape, m, k, n);
+
+        Matrix<T> A(m, k);
+        A.set_to_random(-30, 30);
+        Matrix<T> B(k, n);
+        B.set_to_random(-30, 30);
+
+        for (const auto& algorithm : settings.algorithms)
+        {
+            auto multiply = get_algorithm<T>(algorithm);
+            if (!multiply)
+            {
+                fprintf(stderr, "Error: unknown algorithm %s\n",
+                    algorithm.c_str());
+                exit(1);
+            }
+
+            double max_TB_work = (double) settings.max_TB_size
+                * settings.max_TB_size * settings.max_TB_size;
+            if ((algorithm == "TB") && ((double) m * k * n > max_TB_work))
+                continue;
+
+            for (U i = 0; i < settings.warmup; i++)
+                delete multiply(A, B);
+
+            std::vector<double> times;
+            for (U i = 0; i < settings.repeats; i++)
+            {
+                Matrix<T>* C = nullptr;
+                times.push_back(time_seconds([&] { C = multiply(A, B); }));
+                delete C;
+            }
+
+            // Memory, from an untimed run, so the accounting does not
+            // slow the timed ones.
+            set_memory_stats_enabled(true);
+            delete multiply(A, B);
+            MemoryStats stats = get_memory_stats();
+            set_memory_stats_enabled(false);
+
+            std::sort(times.begin(), times.end());
+            U r = times.size();
+            double median = (r % 2) ? times[r / 2]
+                : (times[r / 2 - 1] + times[r / 2]) / 2;
+
+            Result result;
+            result.type = type;
+            result.algorithm = algorithm;
+            result.m = m;
+            result.k = k;
+            result.n = n;
+            result.threads = get_num_threads();
+            result.repeats = r;
+            result.median = median;
+            result.min = times[0];
+            result.gflops = 2.0 * m * k * n / median / 1e9;
+            result.bandwidth = (double) (m * k + k * n + m * n) * sizeof(T)
+                / median / 1e9;
+            result.peak_bytes = stats.peak_bytes;
+            result.allocations = stats.allocations;
+            result.copied_bytes = stats.copied_bytes;
+            results.push_back(result);
+
+            // Progress, on stderr, so as not to mix with the results.
+            fprintf(stderr, "%s %s %zux%zux%zu: %.6f s\n", type.c_str(),
+                algorithm.c_str(), m, k, n, median);
+        }
+    }
+}
+
+// ----------------------------------------------------
+
+static void write_text(FILE* out, const std::vector<Result>& results)
+{
+    fprintf(out, "%-7s %-10s %17s %7s %12s %12s %9s %9s %10s %7s\n",
+        "type", "algorithm", "m x k x n", "threads", "median (s)",
+        "min (s)", "GFLOP/s", "GB/s", "peak (MB)", "allocs");
+
+    for (const auto& r : results)
+    {
+        string dims = to_string(r.m) + "x" + to_string(r.k) + "x"
+            + to_string(r.n);
+        fprintf(out,
+            "%-7s %-10s %17s %7zu %12.6f %12.6f %9.2f %9.2f %10.2f %7zu\n",
+            r.type.c_str(), r.algorithm.c_str(), dims.c_str(), r.threads,
+            r.median, r.min, r.gflops, r.bandwidth, r.peak_bytes / 1e6,
+            r.allocations);
+    }
+}
+
+static const char* CSV_HEADER =
+    "type,algorithm,m,k,n,threads,repeats,median_s,min_s,gflops,bandwidth_gbs,"
+    "peak_bytes,allocations,copied_bytes";
+
+// The columns that compare_with_baseline() reads; later ones may be added.
+static const char* CSV_KEY_COLUMNS =
+    "type,algorithm,m,k,n,threads,repeats,median_s";
+
+static void write_csv(FILE* out, const std::vector<Result>& results)
+{
+    fprintf(out, "%s\n", CSV_HEADER);
+
+    for (const auto& r : results)
+        fprintf(out, "%s,%s,%zu,%zu,%zu,%zu,%zu,%.9f,%.9f,%.4f,%.4f,"
+            "%zu,%zu,%zu\n",
+            r.type.c_str(), r.algorithm.c_str(), r.m, r.k, r.n, r.threads,
+            r.repeats, r.median, r.min, r.gflops, r.bandwidth, r.peak_bytes,
+            r.allocations, r.copied_bytes);
+}
+
+static void write_json(FILE* out, const std::vector<Result>& results)
+{
+    fprintf(out, "{\n");
+    fprintf(out, "  \"machine\": { \"threads\": %zu, \"isa\": \"%s\" },\n",
+        get_num_threads(), get_ISA_name(get_best_ISA()));
+    fprintf(out, "  \"settings\": { \"warmup\": %zu, \"repeats\": %zu,"
+        " \"SB_leaf_size\": %zu },\n",
+        settings.warmup, settings.repeats, get_SB_leaf_size());
+    fprintf(out, "  \"results\": [\n");
+
+    for (U i = 0; i < results.size(); i++)
+    {
+        const auto& r = results[i];
+        fprintf(out,
+            "    { \"type\": \"%s\", \"algorithm\": \"%s\","
+            " \"m\": %zu, \"k\": %zu, \"n\": %zu, \"threads\": %zu,"
+            " \"repeats\": %zu, \"median_s\": %.9f, \"min_s\": %.9f,"
+            " \"gflops\": %.4f, \"bandwidth_gbs\": %.4f,"
+            " \"peak_bytes\": %zu, \"allocations\": %zu,"
+            " \"copied_bytes\": %zu }%s\n",
+            r.type.c_str(), r.algorithm.c_str(), r.m, r.k, r.n, r.threads,
+            r.repeats, r.median, r.min, r.gflops, r.bandwidth, r.peak_bytes,
+            r.allocations, r.copied_bytes,
+            (i + 1 < results.size()) ? "," : "");
+    }
+
+    fprintf(out, "  ]\n}\n");
+}
+
+// ----------------------------------------------------
+
+// Compare `results` with the baseline file.  Return the number of
+// regressions.
+static U compare_with_baseline(const std::vector<Result>& results)
+{
+    std::ifstream file(settings.baseline);
+    if (!file)
+    {
+        fprintf(stderr, "Error: cannot read baseline %s\n",
+            settings.baseline.c_str());
+        exit(1);
+    }
+
+    // key (type,algorithm,m,k,n,threads) -> median time
+    std::map<string, double> baseline;
+    string line;
+
+    std::getline(file, line);
+    if (line.compare(0, strlen(CSV_KEY_COLUMNS), CSV_KEY_COLUMNS))
+    {
+        fprintf(stderr, "Error: %s is not a CSV file from this benchmark\n",
+            settings.baseline.c_str());
+        exit(1);
+    }
+
+    while (std::getline(file, line))
+    {
+        auto fields = split(line, ',');
+        if (fields.size() < 8)
+            continue;
+
+        string key = fields[0];
+        for (U i = 1; i < 6; i++)
+            key += "," + fields[i];
+        baseline[key] = atof(fields[7].c_str());
+    }
+
+    U num_compared = 0;
+    U num_regressions = 0;
+
+    for (const auto& r : results)
+    {
+        auto it = baseline.find(r.get_key());
+        if (it == baseline.end())
+            continue;
+
+        num_compared++;
+        double change = 100 * (r.median / it->second - 1);
+
+        if (change > settings.threshold)
+        {
+            num_regressions++;
+            fprintf(stderr, "Regression: %s %s %zux%zux%zu: %.6f s,"
+                " baseline %.6f s (%+.1f%%)\n", r.type.c_str(),
+                r.algorithm.c_str(), r.m, r.k, r.n, r.median, it->second,
+                change);
+        }
+    }
+
+    fprintf(stderr, "Compared %zu results with %s: %zu regressions"
+        " (threshold %.1f%%).\n", num_compared, settings.baseline.c_str(),
+        num_regressions, settings.threshold);
+
+    return num_regressions;
+}
+
+// ----------------------------------------------------
+
+int main(int argc, const char* argv[])
+{
+    Process_ARGV(argc, argv);
+
+    std::vector<Result> results;
+
+    for (const auto& type : settings.types)
+    {
+        if (type == "int")
+            run_benchmarks<int>(type, results);
+        else
+            run_benchmarks<double>(type, results);
+    }
+
+    FILE* out = stdout;
+    if (!settings.output.empty())
+    {
+        out = fopen(settings.output.c_str(), "w");
+        if (!out)
+        {
+            fprintf(stderr, "Error: cannot write %s\n",
+                settings.output.c_str());
+            return 1;
+        }
+    }
+
+    if (settings.format == "json")
+        write_json(out, results);
+    else if (settings.format == "csv")
+        write_csv(out, results);
+    else
+        write_text(out, results);
+
+    if (out != stdout)
+        fclose(out);
+
+    if (!settings.baseline.empty() && compare_with_baseline(results))
+        return 1;
+
+    return 0;
+}
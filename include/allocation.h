@@ -0,0 +1,107 @@
+#pragma once
+
+/*
+
+Aligned allocation, and the padding of rows.
+
+------------------------------------------------------------------------
+
+Alignment:
+Matrix buffers and workspaces are allocated on 64-byte (cache-line)
+boundaries.  With padded rows (below), every row of a matrix then starts on
+a cache line, so the vectorized kernels never split a row's first load
+across two lines.
+
+------------------------------------------------------------------------
+
+Huge pages:
+On Linux, allocations of 2 MB or more bypass the heap, and are mapped
+directly with mmap(), on a 2 MB boundary.  They use explicit huge pages
+(MAP_HUGETLB) if the administrator has reserved some (see
+/proc/sys/vm/nr_hugepages), and otherwise ask for transparent huge pages
+(madvise(MADV_HUGEPAGE)), which the kernel provides if THP is set to
+"always" or "madvise" (see /sys/kernel/mm/transparent_hugepage/enabled).
+Either way, each 2 MB page needs one TLB entry instead of 512, so walking
+down the columns of a multi-GB matrix no longer misses the TLB on nearly
+every row.
+
+------------------------------------------------------------------------
+
+Padding:
+A matrix stores its rows `ld` elements apart, where `ld` (the leading
+dimension; see MatrixView) may be larger than the number of columns.
+
+When ld is a power of two, e.g. 1024 doubles, the elements of a column all
+map to the same few cache sets, so walking down a column (as gemm() does when
+it packs its panels, and as the textbook multiply does for B) evicts its own
+lines long before the cache is full.  get_padded_ld() rounds each row up to
+a whole number of cache lines, and then up to an odd number of them, so that
+consecutive rows start in different sets.
+
+Short rows (less than 512 bytes) are not padded: the padding would be a large
+fraction of the row, and small matrices fit in the cache anyway.
+
+------------------------------------------------------------------------
+
+Accounting:
+With set_memory_stats(true), allocate_aligned() and free_aligned() count the
+bytes they hand out and take back.  That covers every matrix buffer
+(Matrix<T>'s construct(), and resize(), and so set_to_copy() and
+set_to_identity(U)), and every workspace, which between them hold all of the
+memory the algorithms use.  (gemm()'s packing buffers, a few hundred KB per
+thread, are not counted.)  Matrix<T> also counts the bytes copied by
+set_to_copy() and set_block_to_copy(), and so by assemble().
+
+The counts start from zero at set_memory_stats(true), or at
+reset_memory_stats(): live_bytes is the bytes allocated, less the bytes
+freed, since then, and peak_bytes is its largest value.  So to measure the
+memory an algorithm needs, reset the stats, run it, and read peak_bytes.
+
+Accounting is off by default: it costs a few atomic operations per
+allocation, which is little next to the allocation itself, but not nothing.
+
+------------------------------------------------------------------------
+
+*/
+
+#include "matrix.h"
+
+// Return room for n elements of type T, aligned to 64 bytes (or, if large,
+// to a huge page; see above).  The elements are not initialized.
+// Release it with free_aligned(), passing the same n.
+template<typename T>
+T* allocate_aligned(U n);
+
+template<typename T>
+void free_aligned(T* p, U n);
+
+// Return the leading dimension for a matrix with nc columns: nc itself, or
+// (if get_pad_rows() is set) nc padded as described above.
+template<typename T>
+U get_padded_ld(U nc);
+
+// Padding of rows, for new matrices and workspace allocations.
+// On by default.  Turning it off stores rows back to back (ld == nCols),
+// e.g. to measure what the padding buys.
+bool get_pad_rows();
+void set_pad_rows(bool pad);
+
+// Memory accounting.  (See above.)
+struct MemoryStats
+{
+    std::ptrdiff_t live_bytes = 0;  // allocated less freed; see above
+    U peak_bytes = 0;
+    U allocations = 0;
+    U frees = 0;
+    U copied_bytes = 0;
+};
+
+// Off by default.  Turning it on (or off) resets the stats.
+bool get_memory_stats_enabled();
+void set_memory_stats_enabled(bool enabled);
+
+MemoryStats get_memory_stats();
+void reset_memory_stats();
+
+// Count `bytes` copied from one matrix to another, if accounting is on.
+void count_copied_bytes(U bytes);
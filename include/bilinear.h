@@ -0,0 +1,145 @@
+#pragma once
+
+/*
+
+Fast bilinear matrix multiplication algorithms, described by coefficient
+tables, and an engine that runs them.
+
+------------------------------------------------------------------------
+
+Schemes:
+A scheme <m,k,n;R> multiplies an m x k block matrix A by a k x n block
+matrix B, using R block multiplications (the "rank").  Product r is
+
+    M_r = (sum over blocks a of A: U[a][r] * A_a)
+        * (sum over blocks b of B: V[b][r] * B_b)
+
+and block c of the result is
+
+    C_c = sum over r: W[c][r] * M_r
+
+Blocks are numbered in row-major order: block [i][p] of A is a = i * k + p,
+block [p][j] of B is b = p * n + j, and block [i][j] of C is c = i * n + j.
+So U is (m * k) x R, V is (k * n) x R, and W is (m * n) x R, each stored in
+row-major order, with one column per product.  (This is the layout of the
+tables published with, e.g., A. R. Benson and G. Ballard, "A framework for
+practical parallel fast matrix multiplication", PPoPP 2015.)
+
+For instance, the classical algorithm <2,2,2;8> needs 8 products, and
+Strassen's <2,2,2;7> needs 7.  Coefficients must be integers.
+
+So that the engine can keep a level's blocks and terms in fixed-size arrays
+on the stack, and not allocate on every step, a scheme may have at most
+MAX_BLOCKS blocks in each of A, B, and C, and a rank of at most MAX_RANK:
+enough for, e.g., Strassen composed with itself three times, <8,8,8;343>.
+
+------------------------------------------------------------------------
+
+Validation:
+A scheme computes A * B exactly if and only if its tables satisfy the Brent
+equations: for all blocks a = [i][p] of A, b = [p'][j] of B, and
+c = [i'][j'] of C,
+
+    sum over r: U[a][r] * V[b][r] * W[c][r] == (p == p' && i == i' && j == j')
+
+satisfies_Brent_equations() checks all (mk)(kn)(mn) of them.
+
+------------------------------------------------------------------------
+
+The engine:
+view_BL_multiply() recurses with a list of schemes: schemes[0] at the top
+level, schemes[1] at the next, and so on, with the last scheme repeated
+below that.  At each level, it takes the largest blocks of the operands whose
+dimensions are multiples of the scheme's <m,k,n>, multiplies them with the
+scheme, and fixes up any leftover rows, columns, or inner dimension with
+gemm(), as SB_multiply() does for odd sizes.  The recursion stops when some
+dimension is no larger than get_SB_leaf_size(), or smaller than the scheme.
+
+Each operand sum is formed in one pass (or, for a lone block with
+coefficient 1, not at all: the block is used in place).  The engine does not
+look for common subexpressions, so a scheme's additions cost what its tables
+say: e.g. Winograd's tables need more additions than SW_multiply(), which
+reuses intermediate sums.
+
+------------------------------------------------------------------------
+
+*/
+
+#include "matrix.h"
+
+#include <vector>
+
+class BilinearScheme
+{
+public:
+
+    static constexpr U MAX_BLOCKS = 64;     // m * k, k * n, and m * n
+    static constexpr U MAX_RANK = 512;
+
+    // Build a <m,k,n;rank> scheme from its tables.  (See above.)
+    // Exits with an error if the tables have the wrong sizes, or the scheme
+    // exceeds the limits above; it does not check the Brent equations.
+    BilinearScheme(string name, U m, U k, U n, U rank,
+        std::vector<int> U_table, std::vector<int> V_table,
+        std::vector<int> W_table);
+
+    const string& get_name() const { return name; }
+    U get_m() const { return m; }
+    U get_k() const { return k; }
+    U get_n() const { return n; }
+    U get_rank() const { return rank; }
+
+    int get_U(U a, U r) const { return U_table[a * rank + r]; }
+    int get_V(U b, U r) const { return V_table[b * rank + r]; }
+    int get_W(U c, U r) const { return W_table[c * rank + r]; }
+
+    // Return true if the tables satisfy the Brent equations, i.e. if the
+    // scheme computes A * B.  Report the first violation, if any, with
+    // DPRINTF(1).
+    bool satisfies_Brent_equations() const;
+
+    // Return the scheme that applies this scheme to the blocks, and `inner`
+    // to the blocks of the blocks: <m m', k k', n n'; R R'>.
+    BilinearScheme compose(const BilinearScheme& inner) const;
+
+    // ----------------- some well-known schemes ----------------- //
+
+    // The classical algorithm, <m,k,n; m k n>.
+    static BilinearScheme classical(U m, U k, U n);
+
+    // Strassen's algorithm, <2,2,2;7>, with the products of SB_multiply().
+    static BilinearScheme Strassen();
+
+    // Winograd's variant, <2,2,2;7>, with the products of SW_multiply().
+    static BilinearScheme Winograd();
+
+private:
+    string  name;
+    U       m, k, n;
+    U       rank;
+    std::vector<int> U_table;   // (m * k) x rank
+    std::vector<int> V_table;   // (k * n) x rank
+    std::vector<int> W_table;   // (m * n) x rank
+};
+
+using BilinearSchemes = std::vector<BilinearScheme>;
+
+// C = A * B, using `schemes` (see above).  A is m x k, B is k x n, and C is
+// m x n, for any m, k, and n; `schemes` must not be empty.
+// All temporaries come from `ws`, which must have at least
+// get_BL_workspace_size(m, k, n, schemes) free elements.  The first form
+// allocates a workspace of its own.
+template<typename T>
+void view_BL_multiply(MatrixView<T> A, MatrixView<T> B, MatrixView<T> C,
+    const BilinearSchemes& schemes, Workspace<T>& ws);
+template<typename T>
+void view_BL_multiply(MatrixView<T> A, MatrixView<T> B, MatrixView<T> C,
+    const BilinearSchemes& schemes);
+
+// Return the number of workspace elements of type T that view_BL_multiply()
+// needs, with the current leaf size, parallel depth, and number of threads.
+// As in SB_multiply(), the top get_SB_parallel_depth() levels run their
+// products as parallel tasks, holding all of them at once; below that, the
+// products run one at a time, each added into C as soon as it is done.
+template<typename T>
+U get_BL_workspace_size(U m, U k, U n, const BilinearSchemes& schemes);
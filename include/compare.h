@@ -0,0 +1,77 @@
+#pragma once
+
+/*
+
+Comparison of matrices, with tolerances, and a report of the errors.
+
+------------------------------------------------------------------------
+
+Tolerances:
+Elements a (of A) and b (of B) match if any of these holds:
+* absolute: |a - b| <= absolute
+* relative: |a - b| <= relative * max(|a|, |b|)
+* ULPs:     a and b are at most `ulps` representable values apart
+With all three at zero (the default), elements must be equal.  (+0 and -0
+are equal; so, as before, are two NaNs with the same bits.)
+
+For ints, the ULP distance is |a - b|.
+
+------------------------------------------------------------------------
+
+Report:
+Rather than stopping at the first mismatch, the comparison scans every
+element, and reports the largest absolute error, the largest relative error,
+and the largest ULP distance, with the location of each, and the number of
+elements out of tolerance.  Ties go to the first in row-major order.
+
+------------------------------------------------------------------------
+
+Speed:
+Rows are split among the threads.  Each row is scanned by a kernel that the
+compiler vectorizes once per instruction set (see simd.h; in practice, only
+AVX-512 has the 64-bit integer maxima that the kernel uses), which keeps
+only the row's maxima and count; the row is scanned again, to locate a
+maximum, only if it beats the thread's best so far.
+
+------------------------------------------------------------------------
+
+*/
+
+#include "matrix.h"
+
+struct Tolerance
+{
+    double absolute = 0;
+    double relative = 0;
+    U ulps = 0;
+};
+
+// Where an error was largest.
+struct ErrorLocation
+{
+    double error = 0;
+    U row = 0;
+    U col = 0;
+};
+
+struct ComparisonReport
+{
+    bool dimensions_match = false;
+
+    ErrorLocation max_absolute;
+    ErrorLocation max_relative;
+    ErrorLocation max_ulps;
+
+    // The number of elements out of tolerance.
+    U num_mismatches = 0;
+
+    bool passed() const { return dimensions_match && !num_mismatches; }
+};
+
+// Compare A with B, element by element.  (See above.)
+template<typename T>
+ComparisonReport view_compare(MatrixView<T> A, MatrixView<T> B,
+    Tolerance tolerance);
+
+// Print `report`, one line per statistic.
+void print_comparison_report(const ComparisonReport& report);
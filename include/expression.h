@@ -0,0 +1,191 @@
+#pragma once
+
+/*
+
+Elementwise expressions: lazily evaluated sums, differences, and negations
+of matrices (or views).
+
+------------------------------------------------------------------------
+
+Usage:
+Wrap each operand with expr(), combine them with `+`, `-`, and unary `-`,
+and evaluate the result into a destination with view_assign():
+
+    view_assign(C11, expr(M1) + expr(M4) - expr(M5) + expr(M7));
+
+Building the expression does no work, and allocates nothing: it just records
+the operands and the operations, in the type of the expression.
+view_assign() then makes a single pass, reading each operand once and writing
+each element of the destination once.  The same chain, computed with add()
+and subtract(), would make three passes and allocate three temporaries.
+
+------------------------------------------------------------------------
+
+Aliasing:
+The destination may be one of the operands, because each element of the
+result depends only on the same element of each operand.  It must not
+otherwise overlap any operand.
+
+------------------------------------------------------------------------
+
+Vectorization:
+view_assign() is a template, instantiated in the caller, so it is compiled
+for the baseline ISA (and vectorized by the compiler for it), rather than
+dispatched at run time like the kernels in simd.h.  For single operations,
+the `view_` kernels in matrix.h remain the faster choice.
+
+------------------------------------------------------------------------
+
+*/
+
+#include "matrix.h"
+
+// Base class of all expressions.  `E` is the derived class (CRTP).
+// Each expression provides:
+// * value_type
+// * get_nRows(), get_nCols(), is_contiguous()
+// * row(i): a cursor whose operator[](j) evaluates element [i][j]
+//   (for a contiguous expression, row(0) spans the whole matrix)
+template<typename E>
+struct Expression
+{
+    const E& self() const { return static_cast<const E&>(*this); }
+};
+
+// An operand: a view.
+template<typename T>
+struct ViewExpression : Expression<ViewExpression<T>>
+{
+    using value_type = T;
+
+    MatrixView<T> v;
+
+    explicit ViewExpression(MatrixView<T> v) : v(v) {}
+
+    U get_nRows() const { return v.nRows; }
+    U get_nCols() const { return v.nCols; }
+    bool is_contiguous() const { return v.is_contiguous(); }
+
+    struct Row
+    {
+        const T* p;
+        T operator[](U j) const { return p[j]; }
+    };
+    Row row(U i) const { return { v.row(i) }; }
+};
+
+// L + R, or L - R.
+template<typename L, typename R, bool isAddition>
+struct SumExpression : Expression<SumExpression<L, R, isAddition>>
+{
+    using value_type = typename L::value_type;
+
+    L left;
+    R right;
+
+    SumExpression(const L& left, const R& right) : left(left), right(right)
+    {
+        assert(left.get_nRows() == right.get_nRows());
+        assert(left.get_nCols() == right.get_nCols());
+    }
+
+    U get_nRows() const { return left.get_nRows(); }
+    U get_nCols() const { return left.get_nCols(); }
+    bool is_contiguous() const
+        { return left.is_contiguous() && right.is_contiguous(); }
+
+    struct Row
+    {
+        typename L::Row l;
+        typename R::Row r;
+        value_type operator[](U j) const
+            { return isAddition ? (l[j] + r[j]) : (l[j] - r[j]); }
+    };
+    Row row(U i) const { return { left.row(i), right.row(i) }; }
+};
+
+// -E
+template<typename E>
+struct NegateExpression : Expression<NegateExpression<E>>
+{
+    using value_type = typename E::value_type;
+
+    E operand;
+
+    explicit NegateExpression(const E& operand) : operand(operand) {}
+
+    U get_nRows() const { return operand.get_nRows(); }
+    U get_nCols() const { return operand.get_nCols(); }
+    bool is_contiguous() const { return operand.is_contiguous(); }
+
+    struct Row
+    {
+        typename E::Row e;
+        value_type operator[](U j) const { return -e[j]; }
+    };
+    Row row(U i) const { return { operand.row(i) }; }
+};
+
+// ----------------------------------------------------
+
+// Wrap a view, or a whole matrix, as an operand.
+template<typename T>
+ViewExpression<T> expr(MatrixView<T> v) { return ViewExpression<T>(v); }
+
+template<typename T>
+ViewExpression<T> expr(const Matrix<T>& m)
+{
+    return ViewExpression<T>(m.view());
+}
+
+template<typename L, typename R>
+SumExpression<L, R, true>
+operator+(const Expression<L>& left, const Expression<R>& right)
+{
+    return { left.self(), right.self() };
+}
+
+template<typename L, typename R>
+SumExpression<L, R, false>
+operator-(const Expression<L>& left, const Expression<R>& right)
+{
+    return { left.self(), right.self() };
+}
+
+template<typename E>
+NegateExpression<E> operator-(const Expression<E>& operand)
+{
+    return NegateExpression<E>(operand.self());
+}
+
+// ----------------------------------------------------
+
+// C = e, in a single pass.  (See "Aliasing" above.)
+template<typename T, typename E>
+void view_assign(MatrixView<T> C, const Expression<E>& e)
+{
+    const E& x = e.self();
+
+    assert((C.nRows == x.get_nRows()) && (C.nCols == x.get_nCols()));
+
+    // Contiguous operands can be walked as one long row.
+    if (C.is_contiguous() && x.is_contiguous())
+    {
+        U n = C.nRows * C.nCols;
+        T* c = C.data;
+        auto r = x.row(0);
+
+        for (U j = 0; j < n; j++)
+            c[j] = r[j];
+        return;
+    }
+
+    for (U i = 0; i < C.nRows; i++)
+    {
+        T* c = C.row(i);
+        auto r = x.row(i);
+
+        for (U j = 0; j < C.nCols; j++)
+            c[j] = r[j];
+    }
+}
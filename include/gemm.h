@@ -0,0 +1,55 @@
+#pragma once
+
+/*
+
+Packed, register-tiled GEMM kernel, in the style of GotoBLAS/BLIS.
+
+------------------------------------------------------------------------
+
+Storage:
+All operands are row-major.  Each one is described by a pointer to its
+top-left element and a leading dimension (`ld`): the distance, in elements,
+between the starts of consecutive rows.  A block of a larger matrix is
+therefore just a pointer into it, with the larger matrix's `ld`.
+
+------------------------------------------------------------------------
+
+Loop structure (see "Anatomy of High-Performance Matrix Multiplication",
+Goto and van de Geijn, and the BLIS papers):
+
+* B is cut into KC x NC panels, which are packed so that they stay in L3.
+* A is cut into MC x KC blocks, which are packed so that they stay in L2.
+* The microkernel computes an MR x NR tile of C in registers, streaming an
+  MR-row sliver of packed A and an NR-column sliver of packed B (which stays
+  in L1) through it.
+
+Packing copies each sliver into contiguous memory, in the exact order the
+microkernel reads it, so the microkernel never strides through memory.
+
+------------------------------------------------------------------------
+
+Microkernels:
+There is one microkernel per element type and instruction set (scalar, SSE2,
+AVX2 + FMA, AVX-512F + FMA), each with its own MR x NR.  gemm() uses the one
+selected by get_gemm_ISA(), which defaults to the best one the CPU supports.
+
+------------------------------------------------------------------------
+
+*/
+
+#include "matrix.h"
+#include "simd.h"
+
+// C += A * B, where
+// * A is m-by-k, with leading dimension lda
+// * B is k-by-n, with leading dimension ldb
+// * C is m-by-n, with leading dimension ldc
+template<typename T>
+void gemm(U m, U n, U k,
+    const T* A, U lda, const T* B, U ldb, T* C, U ldc);
+
+// The instruction set whose microkernels gemm() uses.
+// Defaults to get_best_ISA().
+// set_gemm_ISA() is mostly for testing; it clamps `isa` to get_best_ISA().
+ISA get_gemm_ISA();
+void set_gemm_ISA(ISA isa);
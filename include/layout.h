@@ -0,0 +1,170 @@
+#pragma once
+
+/*
+
+Storage layouts: row-major, and tiled Morton (Z-order).
+
+------------------------------------------------------------------------
+
+Layouts:
+A `Matrix<T>` is always stored in row-major order (with padded rows; see
+allocation.h).  The recursive algorithms work on quadrants of it, and a
+quadrant of a row-major matrix is nRows/2 short runs, ld apart: the deeper
+the recursion, the more scattered its memory.
+
+In the tiled Morton layout, an m x n matrix is cut into a grid of
+2**levels x 2**levels tiles, each tile_rows x tile_cols, and stored tile by
+tile in Z-order:
+
+    +----+----+----+----+
+    |  0 |  1 |  4 |  5 |
+    +----+----+----+----+
+    |  2 |  3 |  6 |  7 |
+    +----+----+----+----+
+    |  8 |  9 | 12 | 13 |
+    +----+----+----+----+
+    | 10 | 11 | 14 | 15 |
+    +----+----+----+----+
+
+Each tile is stored in row-major order, with ld == tile_cols.  Then every
+quadrant, at every level, is one contiguous range, a quarter of its parent:
+quadrant [x][y] starts (2 x + y) quarters in.  So the elementwise steps of
+Strassen's algorithm are single passes over flat arrays, and the leaves are
+contiguous tiles, ready for gemm().
+
+The grid is a power of two, so the matrix is padded, with zeros, up to
+(tile_rows << levels) x (tile_cols << levels).  The tile dimensions are
+chosen as small as possible (e.g. rounded up from m / 2**levels), so the
+padding is less than one tile per row of tiles.
+
+Source: S. Chatterjee, A. R. Lebeck, P. K. Patnala, M. Thottethodi,
+"Recursive array layouts and fast matrix multiplication", IEEE TPDS 13(11),
+2002.
+
+------------------------------------------------------------------------
+
+Usage:
+BB_multiply() and SW_multiply() take an optional Layout.  With
+Layout::Morton, they convert A and B to Morton order, multiply in that
+layout, and convert the result back.  The conversions each make one pass
+over their matrix, so they pay off when the multiply is large enough to
+make several passes over each operand.
+
+Callers that keep their data in Morton order (e.g. across many multiplies)
+can call Morton_BB_multiply_add() and Morton_SW_multiply() directly.
+
+------------------------------------------------------------------------
+
+*/
+
+#include "matrix.h"
+
+// Return the position of tile [i][j] in Z-order: the bits of i and j,
+// interleaved, with those of i in the odd positions.
+inline U get_Morton_index(U i, U j)
+{
+    U index = 0;
+
+    for (U bit = 0; (i >> bit) || (j >> bit); bit++)
+        index |= (((i >> bit) & 1) << (2 * bit + 1))
+               | (((j >> bit) & 1) << (2 * bit));
+
+    return index;
+}
+
+// A matrix stored in the tiled Morton layout (see above).  Like MatrixView,
+// a non-owning view: it does not allocate or free `data`.
+template<typename T>
+struct MortonView
+{
+    T*  data;       // first element of tile 0
+    U   levels;     // the grid is 2**levels x 2**levels tiles
+    U   tile_rows;  // number of rows in each tile
+    U   tile_cols;  // number of columns in each tile
+
+    // Dimensions, including the padding.
+    U get_nRows() const { return tile_rows << levels; }
+    U get_nCols() const { return tile_cols << levels; }
+
+    U get_num_elements() const
+        { return (tile_rows * tile_cols) << (2 * levels); }
+
+    // Return quadrant [x][y], for x and y in {0, 1}: the contiguous quarter
+    // of `data` that holds it.  levels must be positive.
+    MortonView<T> quadrant(U x, U y) const
+    {
+        assert(levels > 0);
+        return { data + (2 * x + y) * (get_num_elements() / 4),
+            levels - 1, tile_rows, tile_cols };
+    }
+
+    // Return tile [i][j] of the grid, as a row-major view.
+    MatrixView<T> tile(U i, U j) const
+    {
+        assert((i >> levels) == 0 && (j >> levels) == 0);
+        return { data + get_Morton_index(i, j) * (tile_rows * tile_cols),
+            tile_rows, tile_cols, tile_cols };
+    }
+
+    // Return the only tile.  levels must be zero.
+    MatrixView<T> tile() const
+    {
+        assert(!levels);
+        return { data, tile_rows, tile_cols, tile_cols };
+    }
+};
+
+// Return the number of grid levels to use for an m x k x n multiply: the
+// fewest that bring min(m, k, n) down to `leaf` per tile (or fewer).
+U get_Morton_levels(U m, U k, U n, U leaf);
+
+// Return a view of `data` as an nr x nc matrix in Morton order, with the
+// given number of levels, and the smallest tiles that cover it.
+template<typename T>
+MortonView<T> make_Morton_view(T* data, U nr, U nc, U levels);
+
+// Return the number of elements of make_Morton_view(data, nr, nc, levels).
+U get_Morton_size(U nr, U nc, U levels);
+
+// C = A, converting from row-major to Morton order.  C must be at least as
+// large as A; its padding is set to zero.
+template<typename T>
+void view_to_Morton(MatrixView<T> A, MortonView<T> C);
+
+// C = the top-left C.nRows x C.nCols block of A, converting from Morton to
+// row-major order.
+template<typename T>
+void view_from_Morton(MortonView<T> A, MatrixView<T> C);
+
+// ------------------ kernels in Morton order ------------------ //
+// A, B, and C must have the same number of levels, and tiles of matching
+// shapes: A.tile_cols == B.tile_rows, and so on.
+
+// C += A * B, using the block-based algorithm: the four quadrants of C run
+// as parallel tasks, each adding its two products in turn.
+template<typename T>
+void Morton_BB_multiply_add(MortonView<T> A, MortonView<T> B,
+    MortonView<T> C);
+
+// C = A * B, using the Strassen-Winograd algorithm, with the schedule of
+// SW_multiply().  All temporaries come from `ws`, which must have at least
+// get_Morton_SW_workspace_size(A, B) free elements.
+template<typename T>
+void Morton_SW_multiply(MortonView<T> A, MortonView<T> B, MortonView<T> C,
+    Workspace<T>& ws);
+
+template<typename T>
+U get_Morton_SW_workspace_size(MortonView<T> A, MortonView<T> B);
+
+// ------------------ kernels on row-major views ------------------ //
+// As view_BB_multiply_add() and view_SW_multiply(), but converting A, B, and
+// C to Morton order and back.  The number of levels comes from
+// get_Morton_levels(), with get_BB_leaf_size() or get_SB_leaf_size().
+
+template<typename T>
+void view_Morton_BB_multiply_add(MatrixView<T> A, MatrixView<T> B,
+    MatrixView<T> C);
+
+template<typename T>
+void view_Morton_SW_multiply(MatrixView<T> A, MatrixView<T> B,
+    MatrixView<T> C);
@@ -31,16 +31,52 @@ It is, of course, not meaningful to C++.
 
 ------------------------------------------------------------------------
 
+Views:
+A `MatrixView<T>` is a non-owning window onto a rectangular block of a
+matrix: a pointer to its top-left element, its dimensions, and the row stride
+(`ld`, the "leading dimension") of the matrix it points into.
+Views are cheap to pass by value.  The kernels that take views (the `view_`
+functions below) read and write through them, so recursive algorithms can
+operate directly on quadrants of their inputs and outputs, without copying.
+
+The `view_` functions take their arguments in the order A, B, C.
+
+------------------------------------------------------------------------
+
 Methods that modify `A->data`:
 * They often have the prefix `set_to_` or `set_block_to_`.
 * They modify `data` in-place.
 * They do not modify `nRows` or `nCols`.
-  - Exception: `void set_to_identity(U size)`
+  - Exceptions: `void set_to_identity(U size)`, `set_to_copy()`, and the
+    assignment operators.
+* They never shrink the buffer.  If the new contents fit in the existing
+  buffer (see `get_capacity()`), they reuse it instead of reallocating.
+
+------------------------------------------------------------------------
+
+Storage:
+A matrix stores its rows in order, `ld` elements apart (see `get_ld()`).
+`ld` may exceed `nCols`: rows are padded away from power-of-two strides, and
+the buffer is 64-byte aligned (see allocation.h).  So code that walks `data`
+directly must step by `ld`, not `nCols`; the `view_` kernels do.
+
+------------------------------------------------------------------------
+
+Ownership:
+A `Matrix<T>` owns its data.  Copying a matrix copies the data; moving a
+matrix transfers the buffer, and leaves the source empty (0 x 0, with no
+buffer).  An empty matrix may only be destroyed or assigned to.
+
+The methods that return `Matrix<T>*` return a new matrix, which the caller
+owns and must delete.  The operators (`+`, `-`, `*`) return by value instead,
+and so cannot leak.  When the left operand of `+` or `-` is a temporary, its
+buffer is reused for the result, so `M1 + M2 - M3` allocates only once.
 
 ------------------------------------------------------------------------
 
 */
 
+#include <algorithm>
 #include <assert.h>
 #include <cstdlib>
 #include <cstring>
@@ -48,13 +84,64 @@ Methods that modify `A->data`:
 #include <random>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 #define DEBUG_LEVEL 0
 #define DPRINTF(_level) if (DEBUG_LEVEL >= (_level)) printf
 
 using namespace std;
 
-using U = unsigned int;
+// Sizes and indices.  64-bit, so that offsets such as i * ld + j do not wrap
+// for matrices of more than 2**32 elements.
+using U = std::size_t;
+
+template<typename T> class Workspace;   // see workspace.h
+class BilinearScheme;                   // see bilinear.h
+struct Tolerance;                       // see compare.h
+struct ComparisonReport;                // see compare.h
+
+// Storage layouts for the recursive multiplies.  (See layout.h.)
+enum class Layout { RowMajor, Morton };
+
+const char* get_layout_name(Layout layout);
+
+// A non-owning view of a block within a matrix.
+// Element [i][j] of the view lives at data[i * ld + j].
+// Like Matrix<T>::get_data(), a view gives write access to the data, even
+// when obtained from a const matrix; by convention, the kernels below only
+// write through C.
+template<typename T>
+struct MatrixView
+{
+    T*  data;   // top-left element of the view
+    U   nRows;  // number of rows in view
+    U   nCols;  // number of columns in view
+    U   ld;     // distance between the starts of consecutive rows
+
+    T& at(U i, U j) const { return data[i * ld + j]; }
+    T* row(U i) const { return data + i * ld; }
+
+    // Return the nr x nc block whose top-left element is [init_row][init_col].
+    MatrixView<T> block(U init_row, U init_col, U nr, U nc) const
+    {
+        assert((init_row + nr <= nRows) && (init_col + nc <= nCols));
+        return { data + init_row * ld + init_col, nr, nc, ld };
+    }
+
+    // Return quadrant [x][y], for x and y in {0, 1}.
+    // e.g. quadrant(1, 0) is the bottom-left quadrant (X21).
+    // nRows and nCols must be even.
+    MatrixView<T> quadrant(U x, U y) const
+    {
+        assert(!(nRows % 2) && !(nCols % 2));
+        U r2 = nRows / 2;
+        U c2 = nCols / 2;
+        return block(x * r2, y * c2, r2, c2);
+    }
+
+    // Return true if the rows follow each other with no gaps.
+    bool is_contiguous() const { return (ld == nCols) || (nRows <= 1); }
+};
 
 template<typename T>
 class Matrix
@@ -64,7 +151,12 @@ public:
     // ------------------ constructors and destructor ------------------ //
     Matrix<T>(U nr, U nc)   { construct(nr, nc); }
     Matrix<T>(U n)          { construct(n, n); }
-    ~Matrix<T>()            { delete [] data; }
+    ~Matrix<T>();
+
+    Matrix<T>(const Matrix<T>& B);
+    Matrix<T>(Matrix<T>&& B) noexcept;
+    Matrix<T>& operator=(const Matrix<T>& B);
+    Matrix<T>& operator=(Matrix<T>&& B) noexcept;
 
     // ------------------ getters and setters ------------------ //
     U get_nRows() const { return nRows; }
@@ -73,17 +165,34 @@ public:
     U get_nCols() const { return nCols; }
     void set_nCols(U nc) { nCols = nc; }
 
+    // Distance between the starts of consecutive rows: at least nCols.
+    // (See allocation.h.)
+    U get_ld() const { return ld; }
+
+    // Number of elements the buffer can hold: at least nRows * ld.
+    U get_capacity() const { return capacity; }
+
     // Get and set the [i][j]'th element in data.
-    T get_IJ(U i, U j) const { return data[i * nCols + j]; }
-    void set_IJ(U i, U j, T value) const { data[i * nCols + j] = value; }
+    T get_IJ(U i, U j) const { return data[i * ld + j]; }
+    void set_IJ(U i, U j, T value) const { data[i * ld + j] = value; }
 
     // Get direct access to `A->data`.
+    // Row i starts at data + i * get_ld(): the rows need not be contiguous.
     T* get_data() const { return data; }
     // We don't want, and we don't need, set_data().
 
+    // Get a view of A, or of block{A}.
+    MatrixView<T> view() const { return { data, nRows, nCols, ld }; }
+    MatrixView<T> block_view(U size, U init_row = 0, U init_col = 0) const
+        { return view().block(init_row, init_col, size, size); }
+
     // --------------- methods that modify A->data --------------- //
-    // Set each element of A to a random value.
+    // Set each element of A to a random value: an int in [lower, upper], or
+    // a double in [lower, upper).  Without a seed, use the next one from
+    // get_next_random_seed(), so that each call gives different contents.
+    // (See random.h.)
     void set_to_random(int lower, int upper);
+    void set_to_random(int lower, int upper, U seed);
 
     // Set A to zero matrix of existing dimensions.  Need not be square.
     void set_to_zero();
@@ -104,6 +213,12 @@ public:
     void set_block_to_copy(const Matrix<T>* B, U size,
         U init_row_A = 0, U init_col_A = 0, U init_row_B = 0, U init_col_B = 0);
 
+    // Set A to A + B.
+    void set_to_sum(const Matrix<T>* B);
+
+    // Set A to A - B.
+    void set_to_difference(const Matrix<T>* B);
+
     // ---------------- methods that do not modify A ---------------- //
 
     // Display a block of A.
@@ -125,13 +240,21 @@ public:
     // i.e., if their row counts match and their column counts match.
     bool dimensions_match(const Matrix<T>* B) const;
 
-    // Return A == B, within specified tolerance.
+    // Return A == B, within specified (absolute) tolerance.
     // Note: see related TODO in matrix.cpp .
     bool equals(const Matrix<T>* B, double tolerance = 0) const;
 
+    // Compare A with B, with absolute, relative, and ULP tolerances, and
+    // return a report of the errors.  (See compare.h.)
+    ComparisonReport compare(const Matrix<T>* B,
+        const Tolerance& tolerance) const;
+
     // Return -A.
     Matrix<T>* get_negative() const;
 
+    // Return a copy of block{A}.
+    Matrix<T>* get_block(U size, U init_row = 0, U init_col = 0) const;
+
     // Return block{A} + block{B}.
     // For two n-by-n matrices A and B:
     // add_blocks(B, n, 0, 0, 0, 0) == add_blocks(B, n) == add(B).
@@ -160,30 +283,99 @@ public:
         const;
 
     // Return A * B.
+    // This is the fastest base kernel: the packed GEMM in gemm.h.
     Matrix<T>* multiply(const Matrix<T>* B) const;
 
     // Textbook-based multiply:
     // Return A * B, calculated using the straightforward
     // textbook definition of matrix multiplication.
+    // This is the reference implementation, against which the other
+    // algorithms are tested.
     Matrix<T>* TB_multiply(const Matrix<T>* B) const;
 
     // Block-based multiply:
     // Return A * B, calculated using a simple block-based divide-and-conquer
     // algorithm.
+    // Halve the largest dimension until none is larger than
+    // get_BB_leaf_size(), so that the leaves work on cache-resident blocks,
+    // and multiply those blocks with gemm().  Products are accumulated
+    // directly into the result, with no temporaries.
     Matrix<T>* BB_multiply(const Matrix<T>* B) const;
+    Matrix<T>* BB_multiply(const Matrix<T>* B, Layout layout) const;
 
     // Strassen-based multiply:
     // Return A * B, calculated using Strassen's algorithm.
+    // Recurse until some dimension is no larger than get_SB_leaf_size(), and
+    // multiply those blocks with multiply().  Odd dimensions are peeled off,
+    // and shapes far from square are first split in half, so any sizes work,
+    // with no padding.  (See matrix.cpp for details.)
+    // In the top get_SB_parallel_depth() levels, the seven products run as
+    // parallel tasks, followed by the four combinations.
+    // All temporaries come from one workspace, allocated up front.
     Matrix<T>* SB_multiply(const Matrix<T>* B) const;
 
+    // Strassen-Winograd-based multiply:
+    // Return A * B, calculated using Winograd's variant of Strassen's
+    // algorithm, which needs 15 additions per level instead of 18.
+    // Recurse, and handle any sizes, like SB_multiply().
+    // The steps are scheduled so that each level needs just
+    // two temporaries, for a total of about (2/3) * size**2 elements, but they
+    // run one after another: parallelism comes only from the leaves.
+    Matrix<T>* SW_multiply(const Matrix<T>* B) const;
+    Matrix<T>* SW_multiply(const Matrix<T>* B, Layout layout) const;
+
+    // Note: with Layout::Morton, BB_multiply() and SW_multiply() copy A and B
+    // into the tiled Morton layout, multiply there, and copy the result
+    // back.  (See layout.h.)  Without a layout, they use Layout::RowMajor.
+
+    // Bilinear-scheme-based multiply:
+    // Return A * B, calculated using the fast bilinear algorithms described
+    // by `schemes`: schemes[0] at the top level of the recursion, schemes[1]
+    // at the next, and so on.  (See bilinear.h.)
+    Matrix<T>* BL_multiply(const Matrix<T>* B,
+        const std::vector<BilinearScheme>& schemes) const;
+
+    // Note: BB_multiply(), SB_multiply(), SW_multiply(), and BL_multiply()
+    // are wrappers around view_BB_multiply_add(), view_SB_multiply(),
+    // view_SW_multiply(), and view_BL_multiply() (bilinear.h).
+
+    // ------------------ operators ------------------ //
+    // Dimensions must match, as for the corresponding methods above.
+
+    // Return A + B, A - B, and -A.
+    // The `&&` forms are chosen when A is a temporary; they compute the
+    // result in place, and return A's buffer.
+    Matrix<T> operator+(const Matrix<T>& B) const &;
+    Matrix<T> operator+(const Matrix<T>& B) &&;
+    Matrix<T> operator-(const Matrix<T>& B) const &;
+    Matrix<T> operator-(const Matrix<T>& B) &&;
+    Matrix<T> operator-() const &;
+    Matrix<T> operator-() &&;
+
+    // Return A * B, using multiply().
+    // Always allocates: the product cannot be computed in place.
+    Matrix<T> operator*(const Matrix<T>& B) const;
+
+    // Set A to A + B, and A to A - B.
+    Matrix<T>& operator+=(const Matrix<T>& B)
+        { set_to_sum(&B); return *this; }
+    Matrix<T>& operator-=(const Matrix<T>& B)
+        { set_to_difference(&B); return *this; }
+
 private:
     U     nRows;    // number of rows in matrix
     U     nCols;    // number of columns in matrix
+    U     ld;       // distance between the starts of consecutive rows
     T*    data;     // the data = the actual contents of the matrix
+    U     capacity; // number of elements allocated for `data`
 
     // helper for constructors
     void construct(U nr, U nc);
 
+    // Set the dimensions to nr x nc (and ld to match), reallocating `data`
+    // only if it is too small.  The contents are unspecified afterwards.
+    void resize(U nr, U nc);
+
     // helpers for add/subtract
     Matrix<T>* helper_for_add_sub_blocks(bool isAddition,
         const Matrix<T>* B, U size,
@@ -192,6 +384,65 @@ private:
     Matrix<T>* helper_for_add_sub(bool isAddition, const Matrix<T>* B) const;
 };
 
+// ------------------ kernels that operate on views ------------------ //
+// A, B: inputs; C: output.  Dimensions must match, as for the corresponding
+// Matrix<T> methods.  C must not overlap A or B, except where noted.
+
+// C = A
+template<typename T>
+void view_copy(MatrixView<T> A, MatrixView<T> C);
+
+// C = 0
+template<typename T>
+void view_set_to_zero(MatrixView<T> C);
+
+// C = A + B.  C may be A or B.
+template<typename T>
+void view_add(MatrixView<T> A, MatrixView<T> B, MatrixView<T> C);
+
+// C = A - B.  C may be A or B.
+template<typename T>
+void view_subtract(MatrixView<T> A, MatrixView<T> B, MatrixView<T> C);
+
+// C = -A.  C may be A.
+template<typename T>
+void view_negate(MatrixView<T> A, MatrixView<T> C);
+
+// C = sum over t < num_terms: coefficients[t] * X[t].
+// C may be any of the X[t], any number of times, but must not overlap any
+// other X[t].
+template<typename T>
+void view_linear_combination(U num_terms, const T* coefficients,
+    const MatrixView<T>* X, MatrixView<T> C);
+
+// C += A * B, using gemm().
+template<typename T>
+void view_multiply_add(MatrixView<T> A, MatrixView<T> B, MatrixView<T> C);
+
+// C += A * B, using the block-based algorithm.  (See BB_multiply().)
+// A is m x k, B is k x n, and C is m x n, for any m, k, and n.
+template<typename T>
+void view_BB_multiply_add(MatrixView<T> A, MatrixView<T> B, MatrixView<T> C);
+
+// C = A * B, using Strassen's algorithm.  (See SB_multiply().)
+// A is m x k, B is k x n, and C is m x n, for any m, k, and n.
+// All temporaries come from `ws`, which must have at least
+// get_SB_workspace_size(m, k, n) free elements.  The first form allocates a
+// workspace of its own.
+template<typename T>
+void view_SB_multiply(MatrixView<T> A, MatrixView<T> B, MatrixView<T> C,
+    Workspace<T>& ws);
+template<typename T>
+void view_SB_multiply(MatrixView<T> A, MatrixView<T> B, MatrixView<T> C);
+
+// C = A * B, using the Strassen-Winograd algorithm.  (See SW_multiply().)
+// As for view_SB_multiply(), but with get_SW_workspace_size(m, k, n).
+template<typename T>
+void view_SW_multiply(MatrixView<T> A, MatrixView<T> B, MatrixView<T> C,
+    Workspace<T>& ws);
+template<typename T>
+void view_SW_multiply(MatrixView<T> A, MatrixView<T> B, MatrixView<T> C);
+
 // Assemble the four blocks into a large matrix.
 template<typename T>
 Matrix<T>* assemble(Matrix<T>* m11, Matrix<T>* m12,
@@ -199,3 +450,43 @@ Matrix<T>* assemble(Matrix<T>* m11, Matrix<T>* m12,
 
 // Simple helper for detecting powers of 2.
 bool is_power_of_2(U n);
+
+// Leaf size for SB_multiply() and SW_multiply():
+// Strassen recursion stops at blocks with this many rows, columns, or inner
+// dimension (or fewer).
+// Below this size, the extra additions cost more than the saved
+// multiplications.  Must be at least 1.
+U get_SB_leaf_size();
+void set_SB_leaf_size(U n);
+
+// Parallel depth for SB_multiply():
+// the top `n` levels of the Strassen recursion run their seven products as
+// parallel tasks, so up to 7**n products run at once.  Each such level holds
+// all seven products (and their operands) at the same time, rather than one
+// at a time, so every extra level multiplies the temporary footprint.
+// Zero means serial recursion, with parallelism only inside the leaves.
+U get_SB_parallel_depth();
+void set_SB_parallel_depth(U n);
+
+// Return the number of workspace elements of type T that view_SB_multiply()
+// needs, to multiply an m x k matrix by a k x n matrix (or two size x size
+// matrices), with the current leaf size, parallel depth, and number of
+// threads.
+template<typename T>
+U get_SB_workspace_size(U m, U k, U n);
+template<typename T>
+U get_SB_workspace_size(U size);
+
+// Return the number of workspace elements of type T that view_SW_multiply()
+// needs, as for get_SB_workspace_size(), with the current leaf size.
+template<typename T>
+U get_SW_workspace_size(U m, U k, U n);
+template<typename T>
+U get_SW_workspace_size(U size);
+
+// Leaf size for BB_multiply():
+// the recursion stops at blocks with this many rows, columns, and inner
+// dimension (or fewer).
+// Must be at least 1.
+U get_BB_leaf_size();
+void set_BB_leaf_size(U n);
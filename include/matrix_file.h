@@ -0,0 +1,198 @@
+#pragma once
+
+/*
+
+A binary file format for matrices, and zero-copy loading with mmap().
+
+------------------------------------------------------------------------
+
+Format:
+A file is a fixed 128-byte header (MatrixFileHeader, below), zeros up to
+the next page boundary, and then the payload: the elements, exactly as they
+are laid out in memory.
+
+* Row-major: nRows rows, each of ld elements, of which the first nCols are
+  the matrix, and the rest (the padding; see allocation.h) are zero.
+* Morton: the tiles, in Z-order (see layout.h); nRows and nCols include the
+  padding of the grid, and ld is the tile width.
+
+Numbers are in the byte order of the machine that wrote the file; a file
+from a machine of the other byte order is rejected, not converted.
+
+------------------------------------------------------------------------
+
+Checksum:
+The header carries a 64-bit checksum of the payload: the sum, over the
+payload's 32-bit words, of a mix (a multiply and two xor-shifts) of each
+word with its index.  Unlike a CRC, the terms are independent, so the sum
+is vectorized and split among the threads, at close to memory bandwidth,
+and it still catches flipped bits, and words that trade places.  It is not
+cryptographic.
+
+------------------------------------------------------------------------
+
+Loading:
+MappedMatrix<T>::open() maps the file read-only (mmap(), PROT_READ,
+MAP_SHARED), checks the header, and returns views of the payload in place:
+nothing is read until it is touched, so opening a multi-GB file takes
+milliseconds, whatever its size, and processes that open the same file
+share one copy of it, in the page cache.  The payload is page-aligned, so
+its rows are as aligned as those of a Matrix<T>.
+
+Opening does not check the checksum, which would read the whole file; call
+verify_checksum() for that.  load_matrix(), which copies the file into a new
+Matrix<T>, reads it all anyway, and checks it.
+
+A mapped matrix is read-only: pass its views as operands (A or B) of the
+view_ kernels, never as their destination (C).  A write faults.
+
+Where there is no mmap() (i.e., off POSIX systems), open() reads the file
+into an aligned buffer instead.
+
+------------------------------------------------------------------------
+
+Blocks:
+MatrixFile<T> reads and writes blocks of a row-major file with pread() and
+pwrite(), for files too large to map whole, or to hold in memory (see
+out_of_core.h).  A new file is created full of zeros, and has no header
+(so it is not a valid file) until finish() writes one.  The checksum is a
+sum of independent terms, so it is accumulated block by block, as they are
+written, without reading anything back.
+
+------------------------------------------------------------------------
+
+*/
+
+#include "matrix.h"
+#include "layout.h"
+
+#include <cstdint>
+
+// The element types a file can hold.
+enum class MatrixFileType : uint32_t { Int32 = 1, Float64 = 2 };
+
+struct MatrixFileHeader
+{
+    char     magic[8];          // "MATRIX\0\0"
+    uint32_t byte_order;        // 0x01020304, as written
+    uint32_t version;           // 1
+    uint32_t type;              // MatrixFileType
+    uint32_t layout;            // Layout
+    uint64_t element_size;      // bytes
+    uint64_t nRows;
+    uint64_t nCols;
+    uint64_t ld;                // elements between rows (or tile rows)
+    uint64_t levels;            // Morton only: the grid is 2**levels square
+    uint64_t tile_rows;         // Morton only
+    uint64_t alignment;         // of payload_offset, in bytes
+    uint64_t payload_offset;    // bytes from the start of the file
+    uint64_t payload_bytes;
+    uint64_t checksum;          // of the payload; see above
+    uint8_t  reserved[24];      // zero
+};
+
+static_assert(sizeof(MatrixFileHeader) == 128, "MatrixFileHeader: 128 bytes");
+
+// Write A, in its layout, to `path`, replacing any file there.  Return
+// false, after printing an error, if the file cannot be written.
+template<typename T>
+bool save_matrix(const Matrix<T>* A, const string& path);
+
+template<typename T>
+bool view_save_matrix(MatrixView<T> A, const string& path);
+
+template<typename T>
+bool Morton_save_matrix(MortonView<T> A, const string& path);
+
+// Return a new matrix with the contents of the row-major file at `path`, and
+// rows padded as for any new matrix.  The checksum must match.  Return
+// nullptr, after printing an error, if the file cannot be read, or is not a
+// row-major file of T.
+template<typename T>
+Matrix<T>* load_matrix(const string& path);
+
+// A matrix file, mapped into memory.  (See above.)
+template<typename T>
+class MappedMatrix
+{
+public:
+
+    // Map the file at `path`.  Return nullptr, after printing an error, if it
+    // cannot be mapped, or is not a valid file of T.  The caller owns the
+    // result, and must delete it, which unmaps the file.
+    static MappedMatrix<T>* open(const string& path);
+
+    ~MappedMatrix();
+
+    MappedMatrix(const MappedMatrix&) = delete;
+    MappedMatrix& operator=(const MappedMatrix&) = delete;
+
+    const MatrixFileHeader& get_header() const { return header; }
+    Layout get_layout() const { return (Layout) header.layout; }
+
+    // Return the payload, as a row-major or Morton view.  The layout must
+    // match.  The view is read-only: see above.
+    MatrixView<T> view() const;
+    MortonView<T> Morton_view() const;
+
+    // Return true if the payload matches the checksum in the header.
+    bool verify_checksum() const;
+
+private:
+    MappedMatrix(void* base, U size, bool mapped,
+        const MatrixFileHeader& header);
+
+    void* base;     // start of the file (or of the buffer holding it)
+    U     size;     // bytes at `base`
+    bool  mapped;   // true if `base` is an mmap() of the file
+    MatrixFileHeader header;
+
+    T* get_payload() const
+        { return (T*) ((char*) base + header.payload_offset); }
+};
+
+// A row-major matrix file, open for reading or writing blocks.  (See above.)
+// open() and create() return nullptr, after printing an error, on failure;
+// the other methods, called from inside the algorithms, throw
+// std::runtime_error.  Needs POSIX file I/O.
+template<typename T>
+class MatrixFile
+{
+public:
+
+    // Open the row-major file of T at `path`, for reading.
+    static MatrixFile<T>* open(const string& path);
+
+    // Create an nr x nc row-major file of T at `path`, replacing any file
+    // there, for writing.  Its rows are padded as for a new matrix.
+    static MatrixFile<T>* create(const string& path, U nr, U nc);
+
+    ~MatrixFile();
+
+    MatrixFile(const MatrixFile&) = delete;
+    MatrixFile& operator=(const MatrixFile&) = delete;
+
+    U get_nRows() const { return header.nRows; }
+    U get_nCols() const { return header.nCols; }
+
+    // C = the C.nRows x C.nCols block of the file at [init_row][init_col].
+    void read_block(U init_row, U init_col, MatrixView<T> C) const;
+
+    // Write A to the block of the file at [init_row][init_col].  To keep the
+    // checksum right, write each element once, from one thread at a time.
+    void write_block(MatrixView<T> A, U init_row, U init_col);
+
+    // Write the header of a created file, with its checksum.
+    void finish();
+
+private:
+    MatrixFile(int fd, const MatrixFileHeader& header);
+
+    int fd;
+    MatrixFileHeader header;
+    uint64_t checksum;  // of the blocks written so far
+
+    // Byte offset of element [i][j].
+    U get_offset(U i, U j) const
+        { return header.payload_offset + (i * header.ld + j) * sizeof(T); }
+};
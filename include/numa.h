@@ -0,0 +1,83 @@
+#pragma once
+
+/*
+
+NUMA topology, thread pinning, and the placement of large matrices.
+
+------------------------------------------------------------------------
+
+Topology:
+On a multi-socket machine, memory is split into NUMA nodes, one per socket
+(or more), and each CPU reaches its own node's memory faster, and with more
+bandwidth, than the others'.  The topology is read once, from
+/sys/devices/system/node, restricted to the CPUs this process may run on.
+Without that information (or off Linux), there is a single node, with every
+CPU on it.
+
+------------------------------------------------------------------------
+
+Affinity:
+By default, threads are not pinned, and the OS moves them at will.  With
+set_thread_affinity(), the thread pool pins thread slot t to one CPU:
+
+* Affinity::Compact fills one node's CPUs before moving to the next, so
+  slots 0 .. (N/2 - 1) share node 0, and so on.  This is the policy for
+  bandwidth-bound work on large matrices.
+* Affinity::Scatter deals the slots out to the nodes in turn.
+
+Slot 0 is the thread that creates the pool (in practice, the main thread),
+which joins in parallel work; slots 1 .. N-1 are the pool's workers.
+
+------------------------------------------------------------------------
+
+Placement:
+Linux places each page on the node of the CPU that first touches it.  So a
+matrix filled by a single thread lives entirely on that thread's node, and
+every other socket reads it remotely.
+
+With threads pinned, Matrix<T> first-touches each large buffer as soon as it
+is allocated: the rows are split into one contiguous range per thread slot
+(see get_thread_rows()), and each thread zeroes its own range.  gemm() then
+splits the rows of A and C the same way, with parallel_for_each_thread(), so
+each thread computes the rows of C, from the rows of A, that sit on its own
+node.  (B is read by every thread, from wherever it was placed.)
+
+------------------------------------------------------------------------
+
+*/
+
+#include "matrix.h"
+
+// Return the number of NUMA nodes, and the CPUs of node `node`.
+U get_num_numa_nodes();
+const std::vector<int>& get_numa_node_cpus(U node);
+
+enum class Affinity { None, Compact, Scatter };
+
+const char* get_affinity_name(Affinity affinity);
+
+// Thread affinity policy for the thread pool.  (See above.)
+// Like set_num_threads(), set_thread_affinity() restarts the pool, so it
+// must not be called while a parallel operation is running.
+Affinity get_thread_affinity();
+void set_thread_affinity(Affinity affinity);
+
+// Return the CPU for thread slot `slot`, under the current policy, or -1 if
+// threads are not pinned.
+int get_thread_cpu(U slot);
+
+// Pin the calling thread to `cpu`, or, if cpu is -1, let it run on any CPU
+// this process started with.
+void pin_this_thread(int cpu);
+
+// Return [begin, end): the rows of an nr-row matrix owned by thread slot
+// `slot`, of `num_slots`, in the static partition used for placement.
+std::pair<U, U> get_thread_rows(U nr, U slot, U num_slots);
+
+// Return true if a new buffer of this many bytes should be first-touched in
+// parallel: threads are pinned, and the buffer spans many pages.
+bool is_placed_by_first_touch(U bytes);
+
+// C = 0, with each thread slot zeroing its own rows of C.  (See above.)
+template<typename T>
+void view_first_touch(MatrixView<T> C);
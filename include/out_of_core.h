@@ -0,0 +1,81 @@
+#pragma once
+
+/*
+
+Out-of-core multiplication: C = A * B, for matrix files too large to hold in
+memory.
+
+------------------------------------------------------------------------
+
+Tiles:
+A, B, and C stay on disk, as row-major matrix files (see matrix_file.h).
+C is computed one tm x tn tile at a time: the tile starts at zero, and, for
+each tk-wide slice of the inner dimension, the tm x tk tile of A and the
+tk x tn tile of B are read into memory, and multiplied into it, with the
+in-memory kernel (view_multiply_add(), i.e. gemm(), on all of the threads).
+Once complete, the tile of C is written out.
+
+The tiles are as large as the memory budget allows (see
+get_out_of_core_tiles()), since each element of A is read once per column of
+tiles of C, and each element of B once per row of tiles: with t x t tiles,
+the multiply reads (m k n / t) (1/m + 1/n) elements, against 2 m k n
+flops, so doubling t halves the I/O per flop.
+
+------------------------------------------------------------------------
+
+Overlap:
+The budget holds two tiles each of A, B, and C.  While one pair of A and B
+tiles is being multiplied, a background thread reads the next pair into the
+other buffers; and while one tile of C is being computed, another thread
+writes the previous one.  So as long as the disk delivers the tiles at
+least as fast as gemm() consumes them, the multiply runs at the in-memory
+rate, less the time of the very first read and the very last write.  The
+stats report the time spent waiting for I/O, which is near zero when the
+disk keeps up.
+
+The budget covers the tile buffers, which come from one workspace (see
+workspace.h); gemm()'s own packing buffers, a few hundred KB per thread,
+come on top.
+
+------------------------------------------------------------------------
+
+*/
+
+#include "matrix.h"
+
+struct OutOfCoreStats
+{
+    // The tiles: A's are tile_rows x tile_inner, B's tile_inner x tile_cols,
+    // and C's tile_rows x tile_cols.
+    U tile_rows = 0;
+    U tile_inner = 0;
+    U tile_cols = 0;
+
+    U bytes_read = 0;
+    U bytes_written = 0;
+
+    double seconds = 0;         // in all
+    double wait_seconds = 0;    // waiting for reads and writes to finish
+};
+
+// Write A * B, where A and B are the row-major matrix files at path_A and
+// path_B, to a new file at path_C, holding at most `memory_budget` bytes of
+// tiles in memory.  (See above.)  If `stats` is not null, fill it in.
+// Return false, after printing an error, if the dimensions do not match, or
+// a file cannot be read or written.
+template<typename T>
+bool out_of_core_multiply(const string& path_A, const string& path_B,
+    const string& path_C, U memory_budget, OutOfCoreStats* stats = nullptr);
+
+// Set tm, tk, and tn to the largest tiles for an m x k x n multiply whose
+// buffers (two of each) fit in `memory_budget` bytes: square, and a multiple
+// of 64 on a side, except where a dimension of the multiply is smaller; and
+// then evened out, so that each dimension is cut into tiles of nearly equal
+// size.  Return false if not even 1 x 1 tiles fit.
+template<typename T>
+bool get_out_of_core_tiles(U m, U k, U n, U memory_budget, U& tm, U& tk,
+    U& tn);
+
+// Return the bytes of the buffers for tm x tk x tn tiles.
+template<typename T>
+U get_out_of_core_memory(U tm, U tk, U tn);
@@ -0,0 +1,115 @@
+#pragma once
+
+/*
+
+Hardware performance counters, per phase of the multiplication algorithms.
+
+------------------------------------------------------------------------
+
+Counters:
+On Linux, each thread opens one group of counters with perf_event_open(),
+the first time it enters a phase: cycles, instructions, L1 data cache read
+misses, last-level cache misses, and data TLB read misses.  Only user-space
+events are counted, so a perf_event_paranoid setting of 2 (the usual default)
+is enough.  If the counters cannot be opened (no PMU, as in many VMs, or a
+stricter setting), phases are still timed and counted, and the counters
+read as zero; see is_perf_available().
+
+------------------------------------------------------------------------
+
+Phases:
+A phase is a scope, marked with PERF_SCOPE(phase):
+* SB_sums: the operand sums of SB_multiply()'s seven products
+* SB_products: the seven products (and so the gemm() leaves below them)
+* SB_combine: the combination of the products into the quadrants of C
+* BB_products: the leaf products of BB_multiply()
+* assemble: assemble()
+
+Phases nest, e.g. a product's recursion has sums of its own.  Each thread
+keeps a stack of its open phases, and events are charged to the innermost
+one only, so each phase's counts are exclusive of the phases inside it, and
+the counts of all phases add up without overlap.  A task that a waiting
+thread picks up (see thread_pool.h) is charged the same way, to its own
+phases.
+
+------------------------------------------------------------------------
+
+Reporting:
+The counts of each phase are summed over threads and calls, and reported,
+in total and per call, by print_perf_report().  With set_perf_trace(), each
+call is also reported as it ends.
+
+------------------------------------------------------------------------
+
+Cost:
+Entering or leaving a phase reads the counters, with one system call.  So
+PERF_SCOPE() is compiled in only when PERF_COUNTERS is non-zero (e.g. with
+`make PERF=1`).  Otherwise, like DPRINTF(), it compiles to nothing.
+
+------------------------------------------------------------------------
+
+*/
+
+#include "matrix.h"
+
+#ifndef PERF_COUNTERS
+#define PERF_COUNTERS 0
+#endif
+
+enum class PerfPhase
+{
+    SB_sums, SB_products, SB_combine, BB_products, assemble, Count
+};
+
+const char* get_perf_phase_name(PerfPhase phase);
+
+// The events counted, in one phase, or one call of it.
+struct PerfCounts
+{
+    U calls = 0;
+    U nanoseconds = 0;
+    U cycles = 0;
+    U instructions = 0;
+    U L1_misses = 0;
+    U LLC_misses = 0;
+    U dTLB_misses = 0;
+};
+
+// Charges the events, from construction to destruction, to `phase`, on the
+// calling thread.  (See above.)  Use PERF_SCOPE(), rather than this directly.
+class PerfScope
+{
+public:
+    explicit PerfScope(PerfPhase phase);
+    ~PerfScope();
+
+    PerfScope(const PerfScope&) = delete;
+    PerfScope& operator=(const PerfScope&) = delete;
+
+private:
+    PerfPhase phase;
+    PerfCounts counts;      // this call's counts, so far
+};
+
+#if PERF_COUNTERS
+#define PERF_SCOPE(_phase) PerfScope perf_scope_(_phase)
+#else
+#define PERF_SCOPE(_phase)
+#endif
+
+// Return true if the hardware counters could be opened on this thread.
+bool is_perf_available();
+
+// Return the counts of `phase`, summed over threads and calls.
+PerfCounts get_perf_counts(PerfPhase phase);
+
+// Clear the counts of all phases.
+void reset_perf_counts();
+
+// Print the counts of each phase that ran: totals, and per-call averages.
+void print_perf_report();
+
+// Per-call reporting: print each phase's counts as it ends.
+// Off by default.
+bool get_perf_trace();
+void set_perf_trace(bool trace);
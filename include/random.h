@@ -0,0 +1,61 @@
+#pragma once
+
+/*
+
+Counter-based random numbers, for filling matrices in parallel.
+
+------------------------------------------------------------------------
+
+Generator:
+Philox4x32-10 turns a 128-bit counter and a 64-bit key into four 32-bit
+random numbers, with ten rounds of multiplies and XORs.  Unlike a sequential
+generator, it has no state to carry from one number to the next: any block
+of the sequence can be computed directly from its counter, in O(1).
+
+Source: J. K. Salmon, M. A. Moraes, R. O. Dror, D. E. Shaw,
+"Parallel random numbers: as easy as 1, 2, 3", SC 2011.
+
+------------------------------------------------------------------------
+
+Filling a matrix:
+view_set_to_random() keys the generator with a seed, and derives element
+(i, j) of an m x n view from its row-major index, i * n + j: each 32-bit
+number gives one int, and each pair gives one double.  So the contents depend
+only on the seed and the shape, and not on the number of threads, the order
+in which rows are filled, or the padding of the rows.
+
+Rows are split among the threads, and each row is generated in batches of
+blocks, with a loop that the compiler vectorizes.
+
+------------------------------------------------------------------------
+
+Seeds:
+Matrix<T>::set_to_random() without a seed takes the next one from a
+process-wide sequence, so successive matrices get different contents.
+set_random_seed() restarts the sequence, e.g. to reproduce a run.
+
+------------------------------------------------------------------------
+
+*/
+
+#include "matrix.h"
+
+#include <array>
+#include <cstdint>
+
+// One Philox4x32-10 block.  (See above.)
+std::array<uint32_t, 4> philox4x32(std::array<uint32_t, 4> counter,
+    std::array<uint32_t, 2> key);
+
+// Set each element of C to a random value: an int in [lower, upper], or a
+// double in [lower, upper).  (See above.)
+template<typename T>
+void view_set_to_random(MatrixView<T> C, int lower, int upper, U seed);
+
+// The seed that the next unseeded set_to_random() will use.  Defaults to 0.
+U get_random_seed();
+void set_random_seed(U seed);
+
+// Return the seed for an unseeded set_to_random(), and advance the sequence.
+// Thread-safe.
+U get_next_random_seed();
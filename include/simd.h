@@ -0,0 +1,60 @@
+#pragma once
+
+/*
+
+SIMD support: CPU feature detection, and vectorized elementwise kernels.
+
+------------------------------------------------------------------------
+
+Instruction sets:
+One binary runs on hosts with different instruction sets, so we never build
+with -march=native.  Instead:
+* the GEMM microkernels (gemm.cpp) are compiled once per instruction set,
+  and gemm() picks one at run time, via get_best_ISA();
+* the elementwise kernels below are compiled once per instruction set by the
+  compiler (`target_clones`), and the dynamic loader picks one at startup.
+
+------------------------------------------------------------------------
+
+*/
+
+#include "matrix.h"
+
+// The compiler vectorizes each clone of a function marked SIMD_CLONES for its
+// own instruction set, and the dynamic loader binds the function to the best
+// clone for the host CPU.  (SSE2 is the x86-64 baseline, so "default" covers
+// it.)
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SIMD_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define SIMD_CLONES
+#endif
+
+// Instruction sets we have kernels for, in increasing order of preference.
+enum class ISA
+{
+    SCALAR,     // no explicit vectorization
+    SSE2,       // 128-bit vectors (baseline on x86-64)
+    AVX2,       // 256-bit vectors, with FMA
+    AVX512,     // 512-bit vectors (AVX-512F), with FMA
+};
+
+// Return the best instruction set that this CPU (and OS) supports.
+// Determined once, via CPUID.
+ISA get_best_ISA();
+
+// Return a printable name for `isa`.
+const char* get_ISA_name(ISA isa);
+
+// Elementwise kernels on n contiguous elements.
+// c[i] = a[i] + b[i]
+void vector_add(U n, const int* a, const int* b, int* c);
+void vector_add(U n, const double* a, const double* b, double* c);
+
+// c[i] = a[i] - b[i]
+void vector_sub(U n, const int* a, const int* b, int* c);
+void vector_sub(U n, const double* a, const double* b, double* c);
+
+// c[i] = -a[i]
+void vector_negate(U n, const int* a, int* c);
+void vector_negate(U n, const double* a, double* c);
@@ -0,0 +1,202 @@
+#pragma once
+
+/*
+
+A persistent work-stealing thread pool, and helpers for fork/join parallelism.
+
+------------------------------------------------------------------------
+
+Threads:
+The pool is created on first use and reused by every parallel operation.
+get_num_threads() counts the threads that do work, including the calling
+thread: a pool of N threads has N - 1 workers, and the caller joins in while
+it waits.  With a single thread, tasks simply run inline.
+
+------------------------------------------------------------------------
+
+Scheduling:
+Each worker owns a deque of tasks.  A worker pushes the tasks it spawns onto
+the back of its own deque and pops from the back (LIFO, so recursive tasks
+run depth-first, on warm caches).  An idle worker steals from the front of
+another deque (FIFO, so it takes the oldest, and typically largest, task).
+Tasks spawned by non-worker threads go into a shared injection deque.
+
+A task can also be pinned to one worker, with submit_to(): it goes into that
+worker's private deque, which nobody steals from.  parallel_for_each_thread()
+uses this to give each thread slot its own share of the work, so that, with
+pinned threads (see numa.h), each share runs on a known CPU.
+
+------------------------------------------------------------------------
+
+Waiting:
+TaskGroup::wait() never blocks: while the group's tasks are pending, the
+waiting thread runs other tasks.  So tasks may themselves spawn and wait for
+tasks (recursive parallelism) without deadlocking the pool.
+
+If a task throws, the exception is caught on the thread that ran it, and the
+group's other tasks still run; wait() rethrows the first such exception once
+they have all finished.  So an error inside a parallel multiply reaches the
+caller's try/catch, as it would in a serial one.
+
+------------------------------------------------------------------------
+
+*/
+
+#include "matrix.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using Task = std::function<void()>;
+
+class ThreadPool
+{
+public:
+
+    // Start a pool in which `num_threads` threads (including the caller of
+    // TaskGroup::wait()) do work.
+    ThreadPool(U num_threads);
+    ~ThreadPool();
+
+    U get_num_threads() const { return num_workers + 1; }
+
+    // Queue `task` for execution by some thread in the pool.
+    void submit(Task task);
+
+    // Queue `task` for execution by worker `worker` (in [0, num_workers)),
+    // and no other thread.
+    void submit_to(U worker, Task task);
+
+    // Run one queued task, if there is one.  Return true if we ran a task.
+    bool run_one();
+
+private:
+    struct TaskQueue
+    {
+        std::mutex        lock;
+        std::deque<Task>  tasks;
+        std::deque<Task>  pinned_tasks;     // run by the owner only
+        std::atomic<U>    num_pinned{0};
+    };
+
+    U                                       num_workers;
+    std::vector<std::unique_ptr<TaskQueue>> queues;  // [num_workers] is the
+                                                     // injection queue
+    std::vector<std::thread>                workers;
+
+    std::atomic<U>                          num_queued;
+    std::mutex                              sleep_lock;
+    std::condition_variable                 wake_up;
+    bool                                    stopping;
+
+    void worker_loop(U id);
+
+    // Pop a task pinned to us, or a task from our own queue (back), or steal
+    // one from another queue (front).  Return false if there are none.
+    bool find_task(U id, Task& task);
+};
+
+// Return the process-wide pool, creating it on first use.
+ThreadPool& get_thread_pool();
+
+// The number of threads used by parallel operations, including the calling
+// thread.  Defaults to the number of hardware threads.
+// set_num_threads() restarts the pool, so it must not be called while a
+// parallel operation is running.
+U get_num_threads();
+void set_num_threads(U n);
+
+// Return true if the calling thread is running a task from the pool.
+// Parallel kernels use this to avoid splitting work that is already one of
+// many parallel tasks.
+bool in_parallel_task();
+
+// A set of tasks that can be waited for together.
+class TaskGroup
+{
+public:
+    TaskGroup() : num_pending(0) {}
+
+    // Waits for the tasks, but does not rethrow their exceptions.
+    ~TaskGroup() { finish(); }
+
+    // Run `task`, any callable, asynchronously (or inline, if the pool has
+    // no workers).
+    template<typename Function>
+    void run(Function task);
+
+    // Return once every task passed to run() has finished.
+    // Runs other queued tasks while waiting.  Rethrows the first exception
+    // thrown by a task, if any.
+    void wait();
+
+private:
+    std::atomic<U> num_pending;
+    std::mutex error_lock;
+    std::exception_ptr error;   // the first exception thrown by a task
+
+    // Counts a task as finished, however it ends.
+    struct Finished
+    {
+        std::atomic<U>& num_pending;
+        ~Finished() { num_pending--; }
+    };
+
+    // Run task(), recording the exception, if it throws.
+    template<typename Function>
+    void run_here(Function& task);
+
+    // Wait for the pending tasks.
+    void finish();
+};
+
+template<typename Function>
+void TaskGroup::run_here(Function& task)
+{
+    try
+    {
+        task();
+    }
+    catch(...)
+    {
+        std::lock_guard<std::mutex> guard(error_lock);
+        if (!error)
+            error = std::current_exception();
+    }
+}
+
+template<typename Function>
+void TaskGroup::run(Function task)
+{
+    ThreadPool& pool = get_thread_pool();
+
+    if (pool.get_num_threads() == 1)
+    {
+        run_here(task);
+        return;
+    }
+
+    num_pending++;
+    pool.submit([this, task = std::move(task)]() mutable
+    {
+        Finished finished{ num_pending };
+        run_here(task);
+    });
+}
+
+// Call body(i) for each i in [0, n), in parallel.
+void parallel_for(U n, const std::function<void(U)>& body);
+
+// Call body(slot, num_slots) once for each thread slot in [0, num_slots),
+// where num_slots is get_num_threads(): slot 0 on the calling thread, and
+// slot s on worker s - 1.  So with pinned threads, slot s always runs on
+// get_thread_cpu(s).  Called from within a task, where the workers may be
+// busy, it runs the slots as ordinary tasks, on any thread.
+void parallel_for_each_thread(const std::function<void(U, U)>& body);
@@ -0,0 +1,64 @@
+#pragma once
+
+/*
+
+Probabilistic verification of products, in O(n^2) time.
+
+------------------------------------------------------------------------
+
+Freivalds' check:
+To check that C == A * B, pick a random vector r, and compare A * (B * r)
+with C * r.  That takes three matrix-vector products, O(n^2) in all, instead
+of the O(n^3) of recomputing A * B.  If C == A * B, the two always agree.  If
+not, then with random signs (r[j] = +1 or -1) they differ with probability
+at least 1/2, so `rounds` independent vectors miss a wrong C with
+probability at most 2**-rounds.
+
+The rounds are batched: r is an n x rounds matrix, so each of A, B, and C is
+read once, however many rounds there are.
+
+Source: R. Freivalds, "Probabilistic machines can use less running time",
+IFIP Congress 1977.
+
+------------------------------------------------------------------------
+
+Error bounds:
+For ints, the projections are computed exactly, in 64-bit integers, and must
+match exactly.
+
+For doubles, both A * (B * r) and C (from a fast algorithm, especially) carry
+rounding errors.  Each element i of the two projections must agree to within
+tolerance * s[i], where s = |A| * (|B| * 1) bounds the magnitude of the sums
+that make up element i.  The default tolerance, 1e-10, is far above the
+rounding error of the check itself (at most about n * 2**-53, relative to s,
+or 2e-12 for n = 2**14), and of Strassen-like algorithms at practical sizes,
+and far below the error that a wrong block or sign leaves behind.
+
+------------------------------------------------------------------------
+
+*/
+
+#include "matrix.h"
+
+// Return true if C == A * B, to within the error bounds above, according to
+// Freivalds' check with `rounds` random vectors.
+template<typename T>
+bool view_verify_product(MatrixView<T> A, MatrixView<T> B, MatrixView<T> C,
+    U rounds, double tolerance);
+
+// As above, with get_verify_rounds() and get_verify_tolerance().
+template<typename T>
+bool view_verify_product(MatrixView<T> A, MatrixView<T> B, MatrixView<T> C);
+
+template<typename T>
+bool verify_product(const Matrix<T>* A, const Matrix<T>* B,
+    const Matrix<T>* C);
+
+// Number of random vectors.  Defaults to 20: a wrong product passes with
+// probability at most 2**-20.
+U get_verify_rounds();
+void set_verify_rounds(U n);
+
+// Relative tolerance for doubles.  (See above.)  Defaults to 1e-10.
+double get_verify_tolerance();
+void set_verify_tolerance(double tolerance);
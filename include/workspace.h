@@ -0,0 +1,80 @@
+#pragma once
+
+/*
+
+A workspace: preallocated scratch memory for the temporaries of the
+recursive multiply algorithms.
+
+------------------------------------------------------------------------
+
+Allocation:
+A workspace is a stack (bump) allocator.  allocate() carves the next block
+off the top of the stack; release() pops everything allocated since a mark
+returned by get_used().  Nothing is freed individually, and nothing is
+allocated from the heap after the workspace is constructed.
+
+Each recursion level allocates its temporaries on entry and releases them on
+exit, so the peak usage is the sum over one path down the recursion tree.
+The algorithms provide functions (e.g. get_SB_workspace_size()) that compute
+that peak exactly, so a workspace of that size is always enough.
+
+------------------------------------------------------------------------
+
+Parallelism:
+A workspace is not thread-safe.  Before spawning parallel tasks, an algorithm
+carves one chunk per task off its workspace, and each task builds its own
+(non-owning) workspace on its chunk.  The thread pool then makes one heap
+allocation per spawned task (see thread_pool.h); the levels that run
+serially make none.
+
+------------------------------------------------------------------------
+
+*/
+
+#include "matrix.h"
+
+template<typename T>
+class Workspace
+{
+public:
+
+    // Allocate, and own, room for n elements, aligned to 64 bytes.
+    // (See allocation.h.)
+    Workspace(U n);
+
+    // Use, but do not own, the n elements at `buffer`.  The allocations are
+    // aligned only as far as `buffer` is.
+    Workspace(T* buffer, U n);
+
+    ~Workspace();
+
+    Workspace(const Workspace&) = delete;
+    Workspace& operator=(const Workspace&) = delete;
+
+    // Return the number of elements needed to allocate(nr, nc).
+    // Rows are padded as for a matrix (see get_padded_ld()), and allocations
+    // are rounded up to whole 64-byte cache lines.
+    static U get_allocation_size(U nr, U nc);
+
+    // Carve an nr x nc matrix off the top of the stack.  Its ld is
+    // get_padded_ld(nc).
+    MatrixView<T> allocate(U nr, U nc);
+
+    // Carve n raw elements off the top of the stack.  n must be a multiple
+    // of the cache-line rounding (e.g. a sum of get_allocation_size() values).
+    T* allocate_raw(U n);
+
+    // Pop everything allocated since get_used() returned `mark`.
+    void release(U mark) { assert(mark <= used); used = mark; }
+
+    U get_capacity() const { return capacity; }
+    U get_used() const { return used; }
+    U get_peak() const { return peak; }
+
+private:
+    T*    buffer;
+    U     capacity;     // in elements
+    U     used;         // in elements
+    U     peak;         // highest value of `used` so far
+    bool  owns_buffer;
+};
@@ -0,0 +1,219 @@
+#include "allocation.h"
+
+#include <atomic>
+#include <new>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+// Explicit template instantiation.  (See matrix.cpp for details.)
+#define INSTANTIATE_ALLOCATION(T)                                           \
+    template T* allocate_aligned<T>(U n);                                   \
+    template void free_aligned<T>(T* p, U n);                               \
+    template U get_padded_ld<T>(U nc);
+
+INSTANTIATE_ALLOCATION(int)
+INSTANTIATE_ALLOCATION(double)
+
+// ----------------------------------------------------
+
+static const U ALIGNMENT = 64;          // bytes: one cache line
+static const U MIN_PADDED_ROW = 512;    // bytes: see allocation.h
+static const U HUGE_PAGE = 2 << 20;     // bytes: see allocation.h
+
+static bool pad_rows = true;
+
+bool get_pad_rows()
+{
+    return pad_rows;
+}
+
+void set_pad_rows(bool pad)
+{
+    pad_rows = pad;
+}
+
+// ----------------------------------------------------
+
+static std::atomic<bool> memory_stats_enabled(false);
+
+static std::atomic<std::ptrdiff_t> live_bytes(0);
+static std::atomic<U> peak_bytes(0);
+static std::atomic<U> num_allocations(0);
+static std::atomic<U> num_frees(0);
+static std::atomic<U> copied_bytes(0);
+
+bool get_memory_stats_enabled()
+{
+    return memory_stats_enabled;
+}
+
+void set_memory_stats_enabled(bool enabled)
+{
+    reset_memory_stats();
+    memory_stats_enabled = enabled;
+}
+
+MemoryStats get_memory_stats()
+{
+    MemoryStats stats;
+    stats.live_bytes = live_bytes;
+    stats.peak_bytes = peak_bytes;
+    stats.allocations = num_allocations;
+    stats.frees = num_frees;
+    stats.copied_bytes = copied_bytes;
+    return stats;
+}
+
+void reset_memory_stats()
+{
+    live_bytes = 0;
+    peak_bytes = 0;
+    num_allocations = 0;
+    num_frees = 0;
+    copied_bytes = 0;
+}
+
+static void count_allocation(U bytes)
+{
+    if (!memory_stats_enabled.load(std::memory_order_relaxed))
+        return;
+
+    num_allocations.fetch_add(1, std::memory_order_relaxed);
+    std::ptrdiff_t live = live_bytes.fetch_add(bytes,
+        std::memory_order_relaxed) + bytes;
+
+    U peak = peak_bytes.load(std::memory_order_relaxed);
+    while ((live > 0) && ((U) live > peak)
+        && !peak_bytes.compare_exchange_weak(peak, live,
+            std::memory_order_relaxed))
+        ;
+}
+
+static void count_free(U bytes)
+{
+    if (!memory_stats_enabled.load(std::memory_order_relaxed))
+        return;
+
+    num_frees.fetch_add(1, std::memory_order_relaxed);
+    live_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+void count_copied_bytes(U bytes)
+{
+    if (memory_stats_enabled.load(std::memory_order_relaxed))
+        copied_bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+// ----------------------------------------------------
+
+#ifdef __linux__
+
+// Return true if an allocation of this many bytes is mapped in huge pages.
+static bool is_huge(U bytes)
+{
+    return bytes >= HUGE_PAGE;
+}
+
+static U round_to_huge_pages(U bytes)
+{
+    return (bytes + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+}
+
+// Map `bytes` (a multiple of HUGE_PAGE) of memory: in explicit huge pages,
+// if the system has some reserved, or else on a huge-page boundary, with a
+// request for transparent huge pages.
+static void* map_huge_pages(U bytes)
+{
+    const int PROT = PROT_READ | PROT_WRITE;
+    const int FLAGS = MAP_PRIVATE | MAP_ANONYMOUS;
+
+#ifdef MAP_HUGETLB
+    void* p = mmap(nullptr, bytes, PROT, FLAGS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED)
+        return p;
+#endif
+
+    // mmap() only aligns to a (small) page, so map an extra huge page, and
+    // trim the excess on each side of the aligned range.
+    U padded = bytes + HUGE_PAGE;
+    char* q = static_cast<char*>(mmap(nullptr, padded, PROT, FLAGS, -1, 0));
+    if (q == MAP_FAILED)
+        throw std::bad_alloc();
+
+    U head = (HUGE_PAGE - reinterpret_cast<uintptr_t>(q) % HUGE_PAGE)
+        % HUGE_PAGE;
+    char* p_aligned = q + head;
+
+    if (head)
+        munmap(q, head);
+    munmap(p_aligned + bytes, padded - head - bytes);
+
+#ifdef MADV_HUGEPAGE
+    // Advice only: without THP support, this fails, harmlessly.
+    madvise(p_aligned, bytes, MADV_HUGEPAGE);
+#endif
+
+    return p_aligned;
+}
+
+#endif
+
+template<typename T>
+T* allocate_aligned(U n)
+{
+    if (!n)
+        return nullptr;
+
+    void* p;
+
+#ifdef __linux__
+    if (is_huge(n * sizeof(T)))
+        p = map_huge_pages(round_to_huge_pages(n * sizeof(T)));
+    else
+#endif
+        p = ::operator new(n * sizeof(T), std::align_val_t(ALIGNMENT));
+
+    // Counted only once it has succeeded: a failure throws, and is never
+    // freed.
+    count_allocation(n * sizeof(T));
+
+    return static_cast<T*>(p);
+}
+
+template<typename T>
+void free_aligned(T* p, U n)
+{
+    if (!p)
+        return;
+
+    count_free(n * sizeof(T));
+
+#ifdef __linux__
+    if (is_huge(n * sizeof(T)))
+    {
+        munmap(p, round_to_huge_pages(n * sizeof(T)));
+        return;
+    }
+#endif
+
+    ::operator delete(p, std::align_val_t(ALIGNMENT));
+}
+
+// ----------------------------------------------------
+
+template<typename T>
+U get_padded_ld(U nc)
+{
+    if (!pad_rows || (nc * sizeof(T) < MIN_PADDED_ROW))
+        return nc;
+
+    U line = ALIGNMENT / sizeof(T);
+    U num_lines = (nc + line - 1) / line;
+
+    if (!(num_lines % 2))
+        num_lines++;
+
+    return num_lines * line;
+}
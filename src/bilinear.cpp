@@ -0,0 +1,517 @@
+#include "bilinear.h"
+#include "thread_pool.h"
+#include "workspace.h"
+
+// Explicit template instantiation.  (See matrix.cpp for details.)
+#define INSTANTIATE_BL(T)                                                   \
+    template void view_BL_multiply(MatrixView<T> A, MatrixView<T> B,        \
+        MatrixView<T> C, const BilinearSchemes& schemes, Workspace<T>& ws); \
+    template void view_BL_multiply(MatrixView<T> A, MatrixView<T> B,        \
+        MatrixView<T> C, const BilinearSchemes& schemes);                   \
+    template U get_BL_workspace_size<T>(U m, U k, U n,                      \
+        const BilinearSchemes& schemes);
+
+INSTANTIATE_BL(int)
+INSTANTIATE_BL(double)
+
+// ----------------------------------------------------
+
+BilinearScheme::BilinearScheme(string name, U m, U k, U n, U rank,
+    std::vector<int> U_table, std::vector<int> V_table,
+    std::vector<int> W_table)
+    : name(name), m(m), k(k), n(n), rank(rank),
+      U_table(U_table), V_table(V_table), W_table(W_table)
+{
+    try
+    {
+        if (!m || !k || !n || !rank)
+            throw std::invalid_argument(
+                "BilinearScheme(" + name + "): zero dimension or rank");
+
+        if ((U_table.size() != m * k * rank) ||
+            (V_table.size() != k * n * rank) ||
+            (W_table.size() != m * n * rank))
+            throw std::invalid_argument(
+                "BilinearScheme(" + name + "): table size mismatch");
+
+        if ((m * k > MAX_BLOCKS) || (k * n > MAX_BLOCKS) ||
+            (m * n > MAX_BLOCKS) || (rank > MAX_RANK))
+            throw std::invalid_argument(
+                "BilinearScheme(" + name + "): too many blocks or products");
+    }
+    catch(std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << "\n";
+        exit(1);
+    }
+}
+
+bool BilinearScheme::satisfies_Brent_equations() const
+{
+    for (U a = 0; a < m * k; a++)
+        for (U b = 0; b < k * n; b++)
+            for (U c = 0; c < m * n; c++)
+            {
+                U i = a / k, p = a % k;     // A[i][p]
+                U p2 = b / n, j = b % n;    // B[p2][j]
+                U i2 = c / n, j2 = c % n;   // C[i2][j2]
+
+                int sum = 0;
+                for (U r = 0; r < rank; r++)
+                    sum += get_U(a, r) * get_V(b, r) * get_W(c, r);
+
+                int expected = ((p == p2) && (i == i2) && (j == j2)) ? 1 : 0;
+                if (sum != expected)
+                {
+                    DPRINTF(1)("%s: Brent equation fails for A[%zu][%zu], "
+                        "B[%zu][%zu], C[%zu][%zu]: %d != %d\n", name.c_str(),
+                        i, p, p2, j, i2, j2, sum, expected);
+                    return false;
+                }
+            }
+
+    return true;
+}
+
+// Block [i][j] of the composed scheme's A is block [i / m'][j / k'] of the
+// outer A, and block [i % m'][j % k'] of that; and likewise for B and C.
+// Product r of the composed scheme is outer product r / R' applied to inner
+// product r % R', so its coefficients are the products of theirs.
+BilinearScheme BilinearScheme::compose(const BilinearScheme& inner) const
+{
+    U m2 = inner.m, k2 = inner.k, n2 = inner.n, R2 = inner.rank;
+    U cm = m * m2, ck = k * k2, cn = n * n2, cR = rank * R2;
+
+    std::vector<int> cU(cm * ck * cR), cV(ck * cn * cR), cW(cm * cn * cR);
+
+    for (U r = 0; r < cR; r++)
+    {
+        U r1 = r / R2, r2 = r % R2;
+
+        for (U i = 0; i < cm; i++)
+            for (U p = 0; p < ck; p++)
+                cU[(i * ck + p) * cR + r] =
+                    get_U((i / m2) * k + (p / k2), r1)
+                    * inner.get_U((i % m2) * k2 + (p % k2), r2);
+
+        for (U p = 0; p < ck; p++)
+            for (U j = 0; j < cn; j++)
+                cV[(p * cn + j) * cR + r] =
+                    get_V((p / k2) * n + (j / n2), r1)
+                    * inner.get_V((p % k2) * n2 + (j % n2), r2);
+
+        for (U i = 0; i < cm; i++)
+            for (U j = 0; j < cn; j++)
+                cW[(i * cn + j) * cR + r] =
+                    get_W((i / m2) * n + (j / n2), r1)
+                    * inner.get_W((i % m2) * n2 + (j % n2), r2);
+    }
+
+    return BilinearScheme(name + " x " + inner.name, cm, ck, cn, cR,
+        cU, cV, cW);
+}
+
+// ----------------------------------------------------
+
+BilinearScheme BilinearScheme::classical(U m, U k, U n)
+{
+    U R = m * k * n;
+    std::vector<int> cU(m * k * R), cV(k * n * R), cW(m * n * R);
+
+    // Product r = (i, p, j) is A[i][p] * B[p][j], and goes into C[i][j].
+    for (U i = 0; i < m; i++)
+        for (U p = 0; p < k; p++)
+            for (U j = 0; j < n; j++)
+            {
+                U r = (i * k + p) * n + j;
+                cU[(i * k + p) * R + r] = 1;
+                cV[(p * n + j) * R + r] = 1;
+                cW[(i * n + j) * R + r] = 1;
+            }
+
+    string name = "classical <" + to_string(m) + "," + to_string(k) + ","
+        + to_string(n) + ">";
+
+    return BilinearScheme(name, m, k, n, R, cU, cV, cW);
+}
+
+BilinearScheme BilinearScheme::Strassen()
+{
+    // Columns: M1..M7.  (See SB_step() in matrix.cpp.)
+    return BilinearScheme("Strassen", 2, 2, 2, 7,
+    {   // U: A11, A12, A21, A22
+        1,  0,  1,  0,  1, -1,  0,
+        0,  0,  0,  0,  1,  0,  1,
+        0,  1,  0,  0,  0,  1,  0,
+        1,  1,  0,  1,  0,  0, -1,
+    },
+    {   // V: B11, B12, B21, B22
+        1,  1,  0, -1,  0,  1,  0,
+        0,  0,  1,  0,  0,  1,  0,
+        0,  0,  0,  1,  0,  0,  1,
+        1,  0, -1,  0,  1,  0,  1,
+    },
+    {   // W: C11, C12, C21, C22
+        1,  0,  0,  1, -1,  0,  1,
+        0,  0,  1,  0,  1,  0,  0,
+        0,  1,  0,  1,  0,  0,  0,
+        1, -1,  1,  0,  0,  1,  0,
+    });
+}
+
+BilinearScheme BilinearScheme::Winograd()
+{
+    // Columns: P1..P7.  (See SW_step() in matrix.cpp.)
+    return BilinearScheme("Winograd", 2, 2, 2, 7,
+    {   // U: A11, A12, A21, A22
+        1,  0,  1,  0,  0, -1,  1,
+        0,  1,  1,  0,  0,  0,  0,
+        0,  0, -1,  0,  1,  1, -1,
+        0,  0, -1,  1,  1,  1,  0,
+    },
+    {   // V: B11, B12, B21, B22
+        1,  0,  0,  1, -1,  1,  0,
+        0,  0,  0, -1,  1, -1, -1,
+        0,  1,  0, -1,  0,  0,  0,
+        0,  0,  1,  1,  0,  1,  1,
+    },
+    {   // W: C11, C12, C21, C22
+        1,  1,  0,  0,  0,  0,  0,
+        1,  0,  1,  0,  1,  1,  0,
+        1,  0,  0, -1,  0,  1,  1,
+        1,  0,  0,  0,  1,  1,  1,
+    });
+}
+
+// ----------------------------------------------------
+
+// Return the scheme for recursion level `level`.
+static const BilinearScheme& get_scheme(const BilinearSchemes& schemes,
+    U level)
+{
+    assert(!schemes.empty());
+    return schemes[std::min<size_t>(level, schemes.size() - 1)];
+}
+
+// Return true if view_BL_multiply() multiplies an m x k x n block with
+// gemm(), rather than with `scheme`.
+static bool is_BL_leaf(U m, U k, U n, const BilinearScheme& scheme)
+{
+    return (std::min({m, k, n}) <= get_SB_leaf_size())
+        || (m < scheme.get_m()) || (k < scheme.get_k()) || (n < scheme.get_n());
+}
+
+// Return true if the products at `level` run as parallel tasks.
+static bool is_BL_parallel(U level)
+{
+    return (level < get_SB_parallel_depth()) && (get_num_threads() > 1);
+}
+
+// Return the workspace that BL_multiply_recursive() needs at `level`.
+// This mirrors its allocations:
+// * serial: the operand sums X and Y, and the product M, of one product at a
+//   time, plus the workspace of one recursive call at a time
+// * parallel: all R products, plus X, Y, and the recursive call's workspace
+//   for each of them
+template<typename T>
+static U get_BL_workspace_size(U m, U k, U n, const BilinearSchemes& schemes,
+    U level)
+{
+    const BilinearScheme& scheme = get_scheme(schemes, level);
+
+    if (is_BL_leaf(m, k, n, scheme))
+        return 0;
+
+    U mb = m / scheme.get_m();
+    U kb = k / scheme.get_k();
+    U nb = n / scheme.get_n();
+    U R = scheme.get_rank();
+
+    U per_product = Workspace<T>::get_allocation_size(mb, kb)
+        + Workspace<T>::get_allocation_size(kb, nb)
+        + get_BL_workspace_size<T>(mb, kb, nb, schemes, level + 1);
+    U product = Workspace<T>::get_allocation_size(mb, nb);
+
+    if (is_BL_parallel(level))
+        return R * (product + per_product);
+
+    return product + per_product;
+}
+
+template<typename T>
+U get_BL_workspace_size(U m, U k, U n, const BilinearSchemes& schemes)
+{
+    return get_BL_workspace_size<T>(m, k, n, schemes, 0);
+}
+
+// The blocks of A, B, and C at one level, and the operations on them.
+// Everything is in fixed-size arrays (see BilinearScheme::MAX_BLOCKS and
+// MAX_RANK), so a step allocates nothing but workspace.
+template<typename T>
+class BilinearStep
+{
+public:
+    BilinearStep(const BilinearScheme& scheme,
+        MatrixView<T> A, MatrixView<T> B, MatrixView<T> C)
+        : scheme(scheme)
+    {
+        U sm = scheme.get_m(), sk = scheme.get_k(), sn = scheme.get_n();
+        U mb = A.nRows / sm, kb = A.nCols / sk, nb = B.nCols / sn;
+
+        for (U i = 0; i < sm; i++)
+            for (U p = 0; p < sk; p++)
+                A_blocks[i * sk + p] = A.block(i * mb, p * kb, mb, kb);
+
+        for (U p = 0; p < sk; p++)
+            for (U j = 0; j < sn; j++)
+                B_blocks[p * sn + j] = B.block(p * kb, j * nb, kb, nb);
+
+        for (U i = 0; i < sm; i++)
+            for (U j = 0; j < sn; j++)
+                C_blocks[i * sn + j] = C.block(i * mb, j * nb, mb, nb);
+
+        num_A_blocks = sm * sk;
+        num_B_blocks = sk * sn;
+        num_C_blocks = sm * sn;
+    }
+
+    // Return the left operand of product r: in X, or, if it is a single
+    // block with coefficient 1, that block.
+    MatrixView<T> get_left_operand(U r, MatrixView<T> X) const
+    {
+        return combine(A_blocks, num_A_blocks, r, X,
+            [this](U a, U r) { return scheme.get_U(a, r); });
+    }
+
+    // Likewise, the right operand of product r, in Y.
+    MatrixView<T> get_right_operand(U r, MatrixView<T> Y) const
+    {
+        return combine(B_blocks, num_B_blocks, r, Y,
+            [this](U b, U r) { return scheme.get_V(b, r); });
+    }
+
+    // C_c = sum over r < R: W[c][r] * M[r]
+    void set_C_block(U c, const MatrixView<T>* M) const
+    {
+        T coefficients[BilinearScheme::MAX_RANK];
+        MatrixView<T> terms[BilinearScheme::MAX_RANK];
+        U num_terms = 0;
+
+        for (U r = 0; r < scheme.get_rank(); r++)
+            if (scheme.get_W(c, r))
+            {
+                coefficients[num_terms] = scheme.get_W(c, r);
+                terms[num_terms++] = M[r];
+            }
+
+        view_linear_combination(num_terms, coefficients, terms, C_blocks[c]);
+    }
+
+    // C_c (+)= W[c][r] * M, for each block c of C that uses product r.
+    // `is_set` records which blocks of C already hold a partial sum.
+    void add_product(U r, MatrixView<T> M, bool* is_set) const
+    {
+        for (U c = 0; c < num_C_blocks; c++)
+        {
+            T w = scheme.get_W(c, r);
+            if (!w)
+                continue;
+
+            if (is_set[c])
+            {
+                const T coefficients[] = { 1, w };
+                const MatrixView<T> terms[] = { C_blocks[c], M };
+                view_linear_combination(2, coefficients, terms, C_blocks[c]);
+            }
+            else
+            {
+                view_linear_combination(1, &w, &M, C_blocks[c]);
+                is_set[c] = true;
+            }
+        }
+    }
+
+    U get_num_C_blocks() const { return num_C_blocks; }
+    MatrixView<T> get_C_block(U c) const { return C_blocks[c]; }
+
+private:
+    const BilinearScheme& scheme;
+    MatrixView<T> A_blocks[BilinearScheme::MAX_BLOCKS];
+    MatrixView<T> B_blocks[BilinearScheme::MAX_BLOCKS];
+    MatrixView<T> C_blocks[BilinearScheme::MAX_BLOCKS];
+    U num_A_blocks, num_B_blocks, num_C_blocks;
+
+    template<typename Coefficient>
+    static MatrixView<T> combine(const MatrixView<T>* blocks, U num_blocks,
+        U r, MatrixView<T> X, Coefficient coefficient)
+    {
+        T coefficients[BilinearScheme::MAX_BLOCKS];
+        MatrixView<T> terms[BilinearScheme::MAX_BLOCKS];
+        U num_terms = 0;
+
+        for (U a = 0; a < num_blocks; a++)
+            if (coefficient(a, r))
+            {
+                coefficients[num_terms] = coefficient(a, r);
+                terms[num_terms++] = blocks[a];
+            }
+
+        if ((num_terms == 1) && (coefficients[0] == 1))
+            return terms[0];
+
+        view_linear_combination(num_terms, coefficients, terms, X);
+        return X;
+    }
+};
+
+// C = A * B, for dimensions that are multiples of the scheme's.
+template<typename T>
+static void BL_step(MatrixView<T> A, MatrixView<T> B, MatrixView<T> C,
+    const BilinearSchemes& schemes, Workspace<T>& ws, U level);
+
+// C = A * B, for any dimensions: BL_step() on the largest blocks that fit
+// the scheme, and gemm() for the leftovers.
+template<typename T>
+static void BL_multiply_recursive(MatrixView<T> A, MatrixView<T> B,
+    MatrixView<T> C, const BilinearSchemes& schemes, Workspace<T>& ws,
+    U level)
+{
+    U m = A.nRows;
+    U k = A.nCols;
+    U n = B.nCols;
+
+    const BilinearScheme& scheme = get_scheme(schemes, level);
+
+    if (is_BL_leaf(m, k, n, scheme))
+    {
+        view_set_to_zero(C);
+        view_multiply_add(A, B, C);
+        return;
+    }
+
+    U me = m - m % scheme.get_m();
+    U ke = k - k % scheme.get_k();
+    U ne = n - n % scheme.get_n();
+
+    auto C_fit = C.block(0, 0, me, ne);
+    BL_step(A.block(0, 0, me, ke), B.block(0, 0, ke, ne), C_fit, schemes, ws,
+        level);
+
+    // Leftover inner dimension.
+    if (ke < k)
+        view_multiply_add(A.block(0, ke, me, k - ke),
+            B.block(ke, 0, k - ke, ne), C_fit);
+
+    // Leftover columns of C.
+    if (ne < n)
+    {
+        auto C_cols = C.block(0, ne, m, n - ne);
+        view_set_to_zero(C_cols);
+        view_multiply_add(A, B.block(0, ne, k, n - ne), C_cols);
+    }
+
+    // Leftover rows of C, except for the corner done above.
+    if (me < m)
+    {
+        auto C_rows = C.block(me, 0, m - me, ne);
+        view_set_to_zero(C_rows);
+        view_multiply_add(A.block(me, 0, m - me, k), B.block(0, 0, k, ne),
+            C_rows);
+    }
+}
+
+template<typename T>
+static void BL_step(MatrixView<T> A, MatrixView<T> B, MatrixView<T> C,
+    const BilinearSchemes& schemes, Workspace<T>& ws, U level)
+{
+    const BilinearScheme& scheme = get_scheme(schemes, level);
+    BilinearStep<T> step(scheme, A, B, C);
+
+    U mb = A.nRows / scheme.get_m();
+    U kb = A.nCols / scheme.get_k();
+    U nb = B.nCols / scheme.get_n();
+    U R = scheme.get_rank();
+
+    U mark = ws.get_used();
+
+    if (!is_BL_parallel(level))
+    {
+        // One product at a time, each added into C as soon as it is done.
+        auto X = ws.allocate(mb, kb);
+        auto Y = ws.allocate(kb, nb);
+        auto M = ws.allocate(mb, nb);
+        bool is_set[BilinearScheme::MAX_BLOCKS] = {};
+
+        for (U r = 0; r < R; r++)
+        {
+            BL_multiply_recursive(step.get_left_operand(r, X),
+                step.get_right_operand(r, Y), M, schemes, ws, level + 1);
+            step.add_product(r, M, is_set);
+        }
+
+        // A valid scheme sets every block of C; but just in case.
+        for (U c = 0; c < step.get_num_C_blocks(); c++)
+            if (!is_set[c])
+                view_set_to_zero(step.get_C_block(c));
+
+        ws.release(mark);
+        return;
+    }
+
+    // All the products at once, as parallel tasks, each with a chunk of
+    // the workspace of its own; then each block of C, as a parallel task.
+    MatrixView<T> M[BilinearScheme::MAX_RANK];
+    for (U r = 0; r < R; r++)
+        M[r] = ws.allocate(mb, nb);
+
+    U task_ws_size = Workspace<T>::get_allocation_size(mb, kb)
+        + Workspace<T>::get_allocation_size(kb, nb)
+        + get_BL_workspace_size<T>(mb, kb, nb, schemes, level + 1);
+
+    TaskGroup group;
+
+    for (U r = 0; r < R; r++)
+    {
+        T* chunk = ws.allocate_raw(task_ws_size);
+        group.run([&, r, chunk]
+        {
+            Workspace<T> task_ws(chunk, task_ws_size);
+            auto X = task_ws.allocate(mb, kb);
+            auto Y = task_ws.allocate(kb, nb);
+            BL_multiply_recursive(step.get_left_operand(r, X),
+                step.get_right_operand(r, Y), M[r], schemes, task_ws,
+                level + 1);
+        });
+    }
+
+    group.wait();
+
+    for (U c = 0; c < step.get_num_C_blocks(); c++)
+        group.run([&, c] { step.set_C_block(c, M); });
+
+    group.wait();
+
+    ws.release(mark);
+}
+
+// ----------------------------------------------------
+
+template<typename T>
+void view_BL_multiply(MatrixView<T> A, MatrixView<T> B, MatrixView<T> C,
+    const BilinearSchemes& schemes, Workspace<T>& ws)
+{
+    assert(!schemes.empty());
+    assert(A.nCols == B.nRows);
+    assert((A.nRows == C.nRows) && (B.nCols == C.nCols));
+
+    BL_multiply_recursive(A, B, C, schemes, ws, 0);
+}
+
+template<typename T>
+void view_BL_multiply(MatrixView<T> A, MatrixView<T> B, MatrixView<T> C,
+    const BilinearSchemes& schemes)
+{
+    Workspace<T> ws(get_BL_workspace_size<T>(A.nRows, A.nCols, B.nCols,
+        schemes));
+    view_BL_multiply(A, B, C, schemes, ws);
+}
@@ -0,0 +1,264 @@
+#include "compare.h"
+#include "simd.h"
+#include "thread_pool.h"
+
+#include <cmath>
+#include <cstring>
+
+// Explicit template instantiation.  (See matrix.cpp for details.)
+template ComparisonReport view_compare(MatrixView<int> A, MatrixView<int> B,
+    Tolerance tolerance);
+template ComparisonReport view_compare(MatrixView<double> A,
+    MatrixView<double> B, Tolerance tolerance);
+
+// ----------------------------------------------------
+
+// The largest errors in one row, and its number of mismatches.
+struct RowErrors
+{
+    double absolute = 0;
+    double relative = 0;
+    double ulps = 0;
+    U num_mismatches = 0;
+};
+
+// Return the number of doubles between a and b.  The bit patterns of doubles,
+// read as sign-magnitude integers, are in the same order as the values; so
+// map them onto two's complement, and subtract.
+static inline uint64_t get_ulps(double a, double b)
+{
+    int64_t ia, ib;
+    memcpy(&ia, &a, sizeof(a));
+    memcpy(&ib, &b, sizeof(b));
+
+    const uint64_t SIGN = uint64_t(1) << 63;
+    ia = (ia < 0) ? (int64_t) (SIGN - (uint64_t) ia) : ia;
+    ib = (ib < 0) ? (int64_t) (SIGN - (uint64_t) ib) : ib;
+
+    return (ia > ib) ? (uint64_t) ia - (uint64_t) ib
+                     : (uint64_t) ib - (uint64_t) ia;
+}
+
+// The errors of one pair of elements.  A NaN error counts as infinite.
+static inline void get_errors(double a, double b, double& absolute,
+    double& relative)
+{
+    double d = std::fabs(a - b);
+    double scale = std::max(std::fabs(a), std::fabs(b));
+
+    // (Both are zero if scale is; and both are infinite for inf - inf.)
+    absolute = (d == d) ? d : INFINITY;
+    relative = absolute / ((scale > 0) ? scale : 1);
+    relative = (relative == relative) ? relative : INFINITY;
+}
+
+// Without short-circuits, so that the loops below have no branches.
+static inline bool is_within(double absolute, double relative, uint64_t ulps,
+    const Tolerance& t)
+{
+    return (absolute <= t.absolute) | (relative <= t.relative)
+        | (ulps <= t.ulps);
+}
+
+// The bits of a double that is not negative (nor NaN), read as an integer,
+// are in the same order as its value.  The loops below take their maxima as
+// integers, since the compiler will not vectorize a floating point maximum
+// without -ffast-math.
+static inline uint64_t to_bits(double x)
+{
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(x));
+    return bits;
+}
+
+static inline double from_bits(uint64_t bits)
+{
+    double x;
+    memcpy(&x, &bits, sizeof(x));
+    return x;
+}
+
+// Vectorized, once per instruction set.  (See simd.h.)
+SIMD_CLONES
+static void get_row_errors(U n, const double* a, const double* b,
+    Tolerance t, RowErrors& errors)
+{
+    uint64_t max_absolute = 0, max_relative = 0, max_ulps = 0;
+    U num_mismatches = 0;
+
+    for (U j = 0; j < n; j++)
+    {
+        double absolute, relative;
+        get_errors(a[j], b[j], absolute, relative);
+        uint64_t ulps = get_ulps(a[j], b[j]);
+
+        uint64_t bits = to_bits(absolute);
+        max_absolute = (bits > max_absolute) ? bits : max_absolute;
+        bits = to_bits(relative);
+        max_relative = (bits > max_relative) ? bits : max_relative;
+        max_ulps = (ulps > max_ulps) ? ulps : max_ulps;
+        num_mismatches += !is_within(absolute, relative, ulps, t);
+    }
+
+    errors.absolute = from_bits(max_absolute);
+    errors.relative = from_bits(max_relative);
+    errors.ulps = (double) max_ulps;
+    errors.num_mismatches = num_mismatches;
+}
+
+// For ints, the ULP distance is the absolute error.
+SIMD_CLONES
+static void get_row_errors(U n, const int* a, const int* b,
+    Tolerance t, RowErrors& errors)
+{
+    uint64_t max_absolute = 0, max_relative = 0;
+    U num_mismatches = 0;
+
+    // Exact, since |a - b| < 2**53.
+    double max_difference = std::max({ t.absolute, (double) t.ulps });
+
+    for (U j = 0; j < n; j++)
+    {
+        double absolute, relative;
+        get_errors(a[j], b[j], absolute, relative);
+
+        uint64_t bits = to_bits(absolute);
+        max_absolute = (bits > max_absolute) ? bits : max_absolute;
+        bits = to_bits(relative);
+        max_relative = (bits > max_relative) ? bits : max_relative;
+        num_mismatches += !((absolute <= max_difference)
+            | (relative <= t.relative));
+    }
+
+    errors.absolute = from_bits(max_absolute);
+    errors.relative = from_bits(max_relative);
+    errors.ulps = errors.absolute;
+    errors.num_mismatches = num_mismatches;
+}
+
+// Return the errors of a[j] and b[j].
+static RowErrors get_element_errors(double a, double b)
+{
+    RowErrors e;
+    get_errors(a, b, e.absolute, e.relative);
+    e.ulps = (double) get_ulps(a, b);
+    return e;
+}
+
+static RowErrors get_element_errors(int a, int b)
+{
+    RowErrors e;
+    get_errors(a, b, e.absolute, e.relative);
+    e.ulps = e.absolute;
+    return e;
+}
+
+// ----------------------------------------------------
+
+// If `error` beats `best`, replace it, at (i, j), where j is the first
+// column of row i whose error (per `get`) equals `error`.
+template<typename T, typename Get>
+static void update_max(ErrorLocation& best, double error, U i, const T* a,
+    const T* b, U n, Get get)
+{
+    if (!(error > best.error))
+        return;
+
+    for (U j = 0; j < n; j++)
+    {
+        if (get(get_element_errors(a[j], b[j])) == error)
+        {
+            best = { error, i, j };
+            return;
+        }
+    }
+}
+
+// Merge `part` (of later rows) into `report`.
+static void merge(ComparisonReport& report, const ComparisonReport& part)
+{
+    for (auto member : { &ComparisonReport::max_absolute,
+        &ComparisonReport::max_relative, &ComparisonReport::max_ulps })
+    {
+        if ((part.*member).error > (report.*member).error)
+            report.*member = part.*member;
+    }
+
+    report.num_mismatches += part.num_mismatches;
+}
+
+// Below this many elements, compare on the calling thread.
+static const U MIN_PARALLEL_ELEMENTS = 1 << 16;
+
+template<typename T>
+ComparisonReport view_compare(MatrixView<T> A, MatrixView<T> B,
+    Tolerance tolerance)
+{
+    ComparisonReport report;
+    report.dimensions_match = (A.nRows == B.nRows) && (A.nCols == B.nCols);
+    if (!report.dimensions_match)
+        return report;
+
+    U m = A.nRows;
+    U n = A.nCols;
+
+    auto compare_rows = [&](U begin, U end, ComparisonReport& part)
+    {
+        for (U i = begin; i < end; i++)
+        {
+            const T* a = A.row(i);
+            const T* b = B.row(i);
+
+            RowErrors errors;
+            get_row_errors(n, a, b, tolerance, errors);
+            part.num_mismatches += errors.num_mismatches;
+
+            update_max(part.max_absolute, errors.absolute, i, a, b, n,
+                [](const RowErrors& e) { return e.absolute; });
+            update_max(part.max_relative, errors.relative, i, a, b, n,
+                [](const RowErrors& e) { return e.relative; });
+            update_max(part.max_ulps, errors.ulps, i, a, b, n,
+                [](const RowErrors& e) { return e.ulps; });
+        }
+    };
+
+    if ((m * n < MIN_PARALLEL_ELEMENTS) || (get_num_threads() == 1))
+    {
+        compare_rows(0, m, report);
+        return report;
+    }
+
+    U num_tiles = std::min(m, 4 * get_num_threads());
+    std::vector<ComparisonReport> parts(num_tiles);
+    parallel_for(num_tiles, [&](U tile)
+    {
+        compare_rows(m * tile / num_tiles, m * (tile + 1) / num_tiles,
+            parts[tile]);
+    });
+
+    for (const auto& part : parts)
+        merge(report, part);
+
+    return report;
+}
+
+// ----------------------------------------------------
+
+void print_comparison_report(const ComparisonReport& report)
+{
+    if (!report.dimensions_match)
+    {
+        printf("* dimensions do not match\n");
+        return;
+    }
+
+    printf("* max absolute error: %g, at [%zu][%zu]\n",
+        report.max_absolute.error, report.max_absolute.row,
+        report.max_absolute.col);
+    printf("* max relative error: %g, at [%zu][%zu]\n",
+        report.max_relative.error, report.max_relative.row,
+        report.max_relative.col);
+    printf("* max ULP distance: %.0f, at [%zu][%zu]\n",
+        report.max_ulps.error, report.max_ulps.row, report.max_ulps.col);
+    printf("* elements out of tolerance: %zu\n", report.num_mismatches);
+}
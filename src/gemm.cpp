@@ -0,0 +1,603 @@
+#include "gemm.h"
+#include "numa.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#else
+#define HAVE_X86_SIMD 0
+#endif
+
+// Explicit template instantiation.  (See matrix.cpp for details.)
+template
+void gemm(U m, U n, U k,
+    const int* A, U lda, const int* B, U ldb, int* C, U ldc);
+template
+void gemm(U m, U n, U k,
+    const double* A, U lda, const double* B, U ldb, double* C, U ldc);
+
+// ----------------------------------------------------
+
+// Cache blocking:
+// * a KC x NR sliver of packed B (16-32 KB) stays in L1
+// * an MC x KC block of packed A (up to 288 KB of `double`) stays in L2
+// * a KC x NC panel of packed B (up to 8 MB of `double`) stays in L3
+// MC is a multiple of every MR below, and NC of every NR.
+static const U MC = 144;
+static const U KC = 256;
+static const U NC = 4096;
+
+// The largest MR x NR tile of any microkernel.
+static const U MAX_TILE = 8 * 32;
+
+// ----------------------------------------------------
+
+// A microkernel computes C += Ap * Bp, for one full MR x NR tile of C.
+// * Ap is an MR-row sliver of packed A (see pack_A)
+// * Bp is an NR-column sliver of packed B (see pack_B)
+template<typename T>
+struct Microkernel
+{
+    U MR;
+    U NR;
+    void (*compute)(U kc, const T* Ap, const T* Bp, T* C, U ldc);
+};
+
+// The scalar microkernels: plain C++, which the compiler is free to
+// vectorize for the baseline instruction set.
+template<typename T>
+static void microkernel_scalar(U kc, const T* Ap, const T* Bp, T* C, U ldc)
+{
+    const U MR = 4;
+    const U NR = 8;
+
+    T acc[MR][NR] = {};
+
+    for (U p = 0; p < kc; p++)
+    {
+        for (U i = 0; i < MR; i++)
+            for (U j = 0; j < NR; j++)
+                acc[i][j] += Ap[i] * Bp[j];
+
+        Ap += MR;
+        Bp += NR;
+    }
+
+    for (U i = 0; i < MR; i++)
+        for (U j = 0; j < NR; j++)
+            C[i * ldc + j] += acc[i][j];
+}
+
+#if HAVE_X86_SIMD
+
+// In each SIMD microkernel, every row of the tile is one or two vector
+// registers of accumulators.  Each step of the `p` loop loads one row of the
+// B sliver, broadcasts each element of one column of the A sliver, and
+// multiplies-and-adds them into the accumulators.
+
+// ------------------------ SSE2 ------------------------
+
+// 4 x 4 tile of `double`: 8 accumulators.
+__attribute__((target("sse2")))
+static void microkernel_sse2(U kc, const double* Ap, const double* Bp,
+    double* C, U ldc)
+{
+    const U MR = 4;
+
+    __m128d c[MR][2];
+    for (U i = 0; i < MR; i++)
+        c[i][0] = c[i][1] = _mm_setzero_pd();
+
+    for (U p = 0; p < kc; p++)
+    {
+        __m128d b0 = _mm_loadu_pd(Bp);
+        __m128d b1 = _mm_loadu_pd(Bp + 2);
+
+        for (U i = 0; i < MR; i++)
+        {
+            __m128d a = _mm_set1_pd(Ap[i]);
+            c[i][0] = _mm_add_pd(c[i][0], _mm_mul_pd(a, b0));
+            c[i][1] = _mm_add_pd(c[i][1], _mm_mul_pd(a, b1));
+        }
+
+        Ap += MR;
+        Bp += 4;
+    }
+
+    for (U i = 0; i < MR; i++)
+    {
+        double* Ci = C + i * ldc;
+        _mm_storeu_pd(Ci,     _mm_add_pd(_mm_loadu_pd(Ci),     c[i][0]));
+        _mm_storeu_pd(Ci + 2, _mm_add_pd(_mm_loadu_pd(Ci + 2), c[i][1]));
+    }
+}
+
+// SSE2 has no 32-bit multiply (that came with SSE4.1's pmulld), so build one
+// from two 32x32->64-bit multiplies, of the even and of the odd lanes.
+__attribute__((target("sse2")))
+static inline __m128i mullo_epi32_sse2(__m128i a, __m128i b)
+{
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd  = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(
+        _mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+        _mm_shuffle_epi32(odd,  _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// 4 x 8 tile of `int`: 8 accumulators.
+__attribute__((target("sse2")))
+static void microkernel_sse2(U kc, const int* Ap, const int* Bp,
+    int* C, U ldc)
+{
+    const U MR = 4;
+
+    __m128i c[MR][2];
+    for (U i = 0; i < MR; i++)
+        c[i][0] = c[i][1] = _mm_setzero_si128();
+
+    for (U p = 0; p < kc; p++)
+    {
+        __m128i b0 = _mm_loadu_si128((const __m128i*) Bp);
+        __m128i b1 = _mm_loadu_si128((const __m128i*) (Bp + 4));
+
+        for (U i = 0; i < MR; i++)
+        {
+            __m128i a = _mm_set1_epi32(Ap[i]);
+            c[i][0] = _mm_add_epi32(c[i][0], mullo_epi32_sse2(a, b0));
+            c[i][1] = _mm_add_epi32(c[i][1], mullo_epi32_sse2(a, b1));
+        }
+
+        Ap += MR;
+        Bp += 8;
+    }
+
+    for (U i = 0; i < MR; i++)
+    {
+        __m128i* Ci = (__m128i*) (C + i * ldc);
+        _mm_storeu_si128(Ci,     _mm_add_epi32(_mm_loadu_si128(Ci),     c[i][0]));
+        _mm_storeu_si128(Ci + 1, _mm_add_epi32(_mm_loadu_si128(Ci + 1), c[i][1]));
+    }
+}
+
+// ------------------------ AVX2 ------------------------
+
+// 6 x 8 tile of `double`: 12 accumulators, using FMA.
+__attribute__((target("avx2,fma")))
+static void microkernel_avx2(U kc, const double* Ap, const double* Bp,
+    double* C, U ldc)
+{
+    const U MR = 6;
+
+    __m256d c[MR][2];
+    for (U i = 0; i < MR; i++)
+        c[i][0] = c[i][1] = _mm256_setzero_pd();
+
+    for (U p = 0; p < kc; p++)
+    {
+        __m256d b0 = _mm256_loadu_pd(Bp);
+        __m256d b1 = _mm256_loadu_pd(Bp + 4);
+
+        for (U i = 0; i < MR; i++)
+        {
+            __m256d a = _mm256_broadcast_sd(Ap + i);
+            c[i][0] = _mm256_fmadd_pd(a, b0, c[i][0]);
+            c[i][1] = _mm256_fmadd_pd(a, b1, c[i][1]);
+        }
+
+        Ap += MR;
+        Bp += 8;
+    }
+
+    for (U i = 0; i < MR; i++)
+    {
+        double* Ci = C + i * ldc;
+        _mm256_storeu_pd(Ci,     _mm256_add_pd(_mm256_loadu_pd(Ci),     c[i][0]));
+        _mm256_storeu_pd(Ci + 4, _mm256_add_pd(_mm256_loadu_pd(Ci + 4), c[i][1]));
+    }
+}
+
+// 6 x 16 tile of `int`: 12 accumulators.
+__attribute__((target("avx2")))
+static void microkernel_avx2(U kc, const int* Ap, const int* Bp,
+    int* C, U ldc)
+{
+    const U MR = 6;
+
+    __m256i c[MR][2];
+    for (U i = 0; i < MR; i++)
+        c[i][0] = c[i][1] = _mm256_setzero_si256();
+
+    for (U p = 0; p < kc; p++)
+    {
+        __m256i b0 = _mm256_loadu_si256((const __m256i*) Bp);
+        __m256i b1 = _mm256_loadu_si256((const __m256i*) (Bp + 8));
+
+        for (U i = 0; i < MR; i++)
+        {
+            __m256i a = _mm256_set1_epi32(Ap[i]);
+            c[i][0] = _mm256_add_epi32(c[i][0], _mm256_mullo_epi32(a, b0));
+            c[i][1] = _mm256_add_epi32(c[i][1], _mm256_mullo_epi32(a, b1));
+        }
+
+        Ap += MR;
+        Bp += 16;
+    }
+
+    for (U i = 0; i < MR; i++)
+    {
+        __m256i* Ci = (__m256i*) (C + i * ldc);
+        _mm256_storeu_si256(Ci,
+            _mm256_add_epi32(_mm256_loadu_si256(Ci), c[i][0]));
+        _mm256_storeu_si256(Ci + 1,
+            _mm256_add_epi32(_mm256_loadu_si256(Ci + 1), c[i][1]));
+    }
+}
+
+// ----------------------- AVX-512 -----------------------
+
+// 8 x 16 tile of `double`: 16 accumulators, using FMA.
+__attribute__((target("avx512f")))
+static void microkernel_avx512(U kc, const double* Ap, const double* Bp,
+    double* C, U ldc)
+{
+    const U MR = 8;
+
+    __m512d c[MR][2];
+    for (U i = 0; i < MR; i++)
+        c[i][0] = c[i][1] = _mm512_setzero_pd();
+
+    for (U p = 0; p < kc; p++)
+    {
+        __m512d b0 = _mm512_loadu_pd(Bp);
+        __m512d b1 = _mm512_loadu_pd(Bp + 8);
+
+        for (U i = 0; i < MR; i++)
+        {
+            __m512d a = _mm512_set1_pd(Ap[i]);
+            c[i][0] = _mm512_fmadd_pd(a, b0, c[i][0]);
+            c[i][1] = _mm512_fmadd_pd(a, b1, c[i][1]);
+        }
+
+        Ap += MR;
+        Bp += 16;
+    }
+
+    for (U i = 0; i < MR; i++)
+    {
+        double* Ci = C + i * ldc;
+        _mm512_storeu_pd(Ci,     _mm512_add_pd(_mm512_loadu_pd(Ci),     c[i][0]));
+        _mm512_storeu_pd(Ci + 8, _mm512_add_pd(_mm512_loadu_pd(Ci + 8), c[i][1]));
+    }
+}
+
+// 8 x 32 tile of `int`: 16 accumulators.
+__attribute__((target("avx512f")))
+static void microkernel_avx512(U kc, const int* Ap, const int* Bp,
+    int* C, U ldc)
+{
+    const U MR = 8;
+
+    __m512i c[MR][2];
+    for (U i = 0; i < MR; i++)
+        c[i][0] = c[i][1] = _mm512_setzero_si512();
+
+    for (U p = 0; p < kc; p++)
+    {
+        __m512i b0 = _mm512_loadu_si512(Bp);
+        __m512i b1 = _mm512_loadu_si512(Bp + 16);
+
+        for (U i = 0; i < MR; i++)
+        {
+            __m512i a = _mm512_set1_epi32(Ap[i]);
+            c[i][0] = _mm512_add_epi32(c[i][0], _mm512_mullo_epi32(a, b0));
+            c[i][1] = _mm512_add_epi32(c[i][1], _mm512_mullo_epi32(a, b1));
+        }
+
+        Ap += MR;
+        Bp += 32;
+    }
+
+    for (U i = 0; i < MR; i++)
+    {
+        int* Ci = C + i * ldc;
+        _mm512_storeu_si512(Ci,
+            _mm512_add_epi32(_mm512_loadu_si512(Ci), c[i][0]));
+        _mm512_storeu_si512(Ci + 16,
+            _mm512_add_epi32(_mm512_loadu_si512(Ci + 16), c[i][1]));
+    }
+}
+
+#endif // HAVE_X86_SIMD
+
+// ----------------------------------------------------
+
+// Return the microkernel for `isa`.
+template<typename T> static Microkernel<T> get_microkernel(ISA isa);
+
+template<>
+Microkernel<double> get_microkernel<double>(ISA isa)
+{
+    switch (isa)
+    {
+#if HAVE_X86_SIMD
+        case ISA::AVX512: return { 8, 16, microkernel_avx512 };
+        case ISA::AVX2:   return { 6,  8, microkernel_avx2 };
+        case ISA::SSE2:   return { 4,  4, microkernel_sse2 };
+#endif
+        default:          return { 4,  8, microkernel_scalar<double> };
+    }
+}
+
+template<>
+Microkernel<int> get_microkernel<int>(ISA isa)
+{
+    switch (isa)
+    {
+#if HAVE_X86_SIMD
+        case ISA::AVX512: return { 8, 32, microkernel_avx512 };
+        case ISA::AVX2:   return { 6, 16, microkernel_avx2 };
+        case ISA::SSE2:   return { 4,  8, microkernel_sse2 };
+#endif
+        default:          return { 4,  8, microkernel_scalar<int> };
+    }
+}
+
+static ISA gemm_ISA = get_best_ISA();
+
+ISA get_gemm_ISA()
+{
+    return gemm_ISA;
+}
+
+void set_gemm_ISA(ISA isa)
+{
+    gemm_ISA = std::min(isa, get_best_ISA());
+}
+
+// ----------------------------------------------------
+
+// Pack block{A} (mc x kc) into Ap, as a sequence of MR-row slivers.
+// Within a sliver, element [i][p] lives at Ap[p * MR + i], so the
+// microkernel reads one column of the sliver at a time.
+// Rows beyond mc are padded with zeroes.
+template<typename T>
+static void pack_A(U MR, U mc, U kc, const T* A, U lda, T* Ap)
+{
+    for (U ir = 0; ir < mc; ir += MR)
+    {
+        U mr = std::min(MR, mc - ir);
+
+        for (U p = 0; p < kc; p++)
+        {
+            for (U i = 0; i < mr; i++)
+                Ap[i] = A[(ir + i) * lda + p];
+            for (U i = mr; i < MR; i++)
+                Ap[i] = 0;
+
+            Ap += MR;
+        }
+    }
+}
+
+// Pack block{B} (kc x nc) into Bp, as a sequence of NR-column slivers.
+// Within a sliver, element [p][j] lives at Bp[p * NR + j], so the
+// microkernel reads one row of the sliver at a time.
+// Columns beyond nc are padded with zeroes.
+template<typename T>
+static void pack_B(U NR, U kc, U nc, const T* B, U ldb, T* Bp)
+{
+    for (U jr = 0; jr < nc; jr += NR)
+    {
+        U nr = std::min(NR, nc - jr);
+
+        for (U p = 0; p < kc; p++)
+        {
+            const T* b = B + p * ldb + jr;
+
+            for (U j = 0; j < nr; j++)
+                Bp[j] = b[j];
+            for (U j = nr; j < NR; j++)
+                Bp[j] = 0;
+
+            Bp += NR;
+        }
+    }
+}
+
+// ----------------------------------------------------
+
+// C += Ap * Bp, for the top-left mr x nr corner of one tile of C.
+// Full tiles go straight to the microkernel.  Partial tiles, at the edges of
+// C, are computed into a scratch tile, and only the valid corner is added to
+// C.  (The padding in Ap and Bp makes the rest of the scratch tile zero.)
+template<typename T>
+static void compute_tile(const Microkernel<T>& kernel,
+    U kc, const T* Ap, const T* Bp, T* C, U ldc, U mr, U nr)
+{
+    if ((mr == kernel.MR) && (nr == kernel.NR))
+    {
+        kernel.compute(kc, Ap, Bp, C, ldc);
+        return;
+    }
+
+    T tile[MAX_TILE] = {};
+    kernel.compute(kc, Ap, Bp, tile, kernel.NR);
+
+    for (U i = 0; i < mr; i++)
+        for (U j = 0; j < nr; j++)
+            C[i * ldc + j] += tile[i * kernel.NR + j];
+}
+
+// Packing buffers, per thread, grown on demand and then reused, so that
+// repeated calls do not allocate.
+// A thread that waits for a parallel gemm() runs other tasks meanwhile, and
+// those may call gemm() too.  So keep one set of buffers per nesting level,
+// and let each gemm() (or gemm() task) claim a level for its duration.
+template<typename T>
+class PackBuffers
+{
+public:
+    PackBuffers() : level(get_depth()++)
+    {
+        if (get_levels().size() <= level)
+            get_levels().resize(level + 1);
+    }
+
+    ~PackBuffers() { get_depth()--; }
+
+    T* get_A(U n) { return grow(get_levels()[level].A, n); }
+    T* get_B(U n) { return grow(get_levels()[level].B, n); }
+
+private:
+    struct Level
+    {
+        std::vector<T> A;
+        std::vector<T> B;
+    };
+
+    U level;
+
+    static U& get_depth()
+    {
+        thread_local U depth = 0;
+        return depth;
+    }
+
+    static std::vector<Level>& get_levels()
+    {
+        thread_local std::vector<Level> levels;
+        return levels;
+    }
+
+    static T* grow(std::vector<T>& buffer, U n)
+    {
+        if (buffer.size() < n)
+            buffer.resize(n);
+        return buffer.data();
+    }
+};
+
+// C += A * B, for an mc-row panel of A and C, against a packed kc x nc
+// panel of B.  (The "macro-kernel", in BLIS terms.)
+template<typename T>
+static void multiply_panel(const Microkernel<T>& kernel, U mc, U nc, U kc,
+    const T* A, U lda, const T* Bp, T* C, U ldc)
+{
+    const U MR = kernel.MR;
+    const U NR = kernel.NR;
+
+    PackBuffers<T> buffers;
+    T* Ap = buffers.get_A(((std::min(MC, mc) + MR - 1) / MR) * MR * kc);
+
+    for (U ic = 0; ic < mc; ic += MC)
+    {
+        U mcc = std::min(MC, mc - ic);
+
+        pack_A(MR, mcc, kc, A + ic * lda, lda, Ap);
+
+        for (U jr = 0; jr < nc; jr += NR)
+        {
+            U nr = std::min(NR, nc - jr);
+
+            for (U ir = 0; ir < mcc; ir += MR)
+            {
+                U mr = std::min(MR, mcc - ir);
+
+                compute_tile(kernel, kc, Ap + ir * kc, Bp + jr * kc,
+                    C + (ic + ir) * ldc + jr, ldc, mr, nr);
+            }
+        }
+    }
+}
+
+// Below this many multiply-adds, splitting gemm() across threads costs more
+// than it saves.
+static const double GEMM_PARALLEL_MIN_WORK = 128.0 * 128.0 * 128.0;
+
+template<typename T>
+void gemm(U m, U n, U k,
+    const T* A, U lda, const T* B, U ldb, T* C, U ldc)
+{
+    if (!m || !n || !k)
+        return;
+
+    const Microkernel<T> kernel = get_microkernel<T>(get_gemm_ISA());
+    const U MR = kernel.MR;
+    const U NR = kernel.NR;
+    assert(MR * NR <= MAX_TILE);
+
+    // Split the rows of A and C into one panel per thread (but no more than
+    // MC rows each, and whole slivers of MR rows), which share each packed
+    // panel of B.  Only do so at the top level: when gemm() is itself one of
+    // many parallel tasks (e.g. a leaf of BB_multiply), the threads are
+    // already busy.
+    U num_threads = get_num_threads();
+    bool parallel = (num_threads > 1) && !in_parallel_task() &&
+        ((double) m * n * k >= GEMM_PARALLEL_MIN_WORK);
+
+    bool pinned = parallel && (get_thread_affinity() != Affinity::None);
+
+    U rows_per_thread = (m + num_threads - 1) / num_threads;
+    U rows_per_panel = std::min(MC, ((rows_per_thread + MR - 1) / MR) * MR);
+    U num_panels = (m + rows_per_panel - 1) / rows_per_panel;
+
+    PackBuffers<T> buffers;
+
+    // Round up to whole slivers, to leave room for the padding.
+    T* Bp = buffers.get_B(
+        ((std::min(NC, n) + NR - 1) / NR) * NR * std::min(KC, k));
+
+    for (U jc = 0; jc < n; jc += NC)
+    {
+        U nc = std::min(NC, n - jc);
+
+        for (U pc = 0; pc < k; pc += KC)
+        {
+            U kc = std::min(KC, k - pc);
+
+            pack_B(NR, kc, nc, B + pc * ldb + jc, ldb, Bp);
+
+            if (!parallel)
+            {
+                multiply_panel(kernel, m, nc, kc,
+                    A + pc, lda, Bp, C + jc, ldc);
+                continue;
+            }
+
+            // With pinned threads, give each thread slot the rows it
+            // first-touched (see numa.h), rounded to whole slivers, so it
+            // reads A and writes C on its own node.
+            if (pinned)
+            {
+                parallel_for_each_thread([&](U slot, U num_slots)
+                {
+                    auto slivers = get_thread_rows((m + MR - 1) / MR, slot,
+                        num_slots);
+                    U end_row = std::min(m, slivers.second * MR);
+
+                    for (U ic = slivers.first * MR; ic < end_row; ic += MC)
+                    {
+                        U mc = std::min(MC, end_row - ic);
+
+                        multiply_panel(kernel, mc, nc, kc, A + ic * lda + pc,
+                            lda, Bp, C + ic * ldc + jc, ldc);
+                    }
+                });
+                continue;
+            }
+
+            parallel_for(num_panels, [&](U panel)
+            {
+                U ic = panel * rows_per_panel;
+                U mc = std::min(rows_per_panel, m - ic);
+
+                multiply_panel(kernel, mc, nc, kc,
+                    A + ic * lda + pc, lda, Bp, C + ic * ldc + jc, ldc);
+            });
+        }
+    }
+}
@@ -0,0 +1,342 @@
+#include "layout.h"
+#include "simd.h"
+#include "thread_pool.h"
+#include "workspace.h"
+
+// Explicit template instantiation.  (See matrix.cpp for details.)
+#define INSTANTIATE_LAYOUT(T)                                               \
+    template MortonView<T> make_Morton_view(T* data, U nr, U nc,            \
+        U levels);                                                          \
+    template void view_to_Morton(MatrixView<T> A, MortonView<T> C);         \
+    template void view_from_Morton(MortonView<T> A, MatrixView<T> C);       \
+    template void Morton_BB_multiply_add(MortonView<T> A,                   \
+        MortonView<T> B, MortonView<T> C);                                  \
+    template void Morton_SW_multiply(MortonView<T> A, MortonView<T> B,      \
+        MortonView<T> C, Workspace<T>& ws);                                 \
+    template U get_Morton_SW_workspace_size(MortonView<T> A,                \
+        MortonView<T> B);                                                   \
+    template void view_Morton_BB_multiply_add(MatrixView<T> A,              \
+        MatrixView<T> B, MatrixView<T> C);                                  \
+    template void view_Morton_SW_multiply(MatrixView<T> A,                  \
+        MatrixView<T> B, MatrixView<T> C);
+
+INSTANTIATE_LAYOUT(int)
+INSTANTIATE_LAYOUT(double)
+
+// ----------------------------------------------------
+
+const char* get_layout_name(Layout layout)
+{
+    switch (layout)
+    {
+    case Layout::RowMajor:  return "row-major";
+    case Layout::Morton:    return "Morton";
+    }
+
+    return "unknown";
+}
+
+// ----------------------------------------------------
+
+static U ceil_div(U a, U b)
+{
+    return (a + b - 1) / b;
+}
+
+U get_Morton_levels(U m, U k, U n, U leaf)
+{
+    assert(leaf >= 1);
+
+    U min_dim = std::min({m, k, n});
+    U levels = 0;
+
+    while (ceil_div(min_dim, U(1) << levels) > leaf)
+        levels++;
+
+    return levels;
+}
+
+template<typename T>
+MortonView<T> make_Morton_view(T* data, U nr, U nc, U levels)
+{
+    return { data, levels, ceil_div(nr, U(1) << levels),
+        ceil_div(nc, U(1) << levels) };
+}
+
+U get_Morton_size(U nr, U nc, U levels)
+{
+    return make_Morton_view<int>(nullptr, nr, nc, levels).get_num_elements();
+}
+
+// ----------------------------------------------------
+
+// Each tile of the grid covers the block of the row-major matrix starting at
+// [i * tile_rows][j * tile_cols], clipped to the matrix.  The rows of tiles
+// are converted in parallel.
+
+template<typename T>
+void view_to_Morton(MatrixView<T> A, MortonView<T> C)
+{
+    assert((A.nRows <= C.get_nRows()) && (A.nCols <= C.get_nCols()));
+
+    U tr = C.tile_rows;
+    U tc = C.tile_cols;
+
+    parallel_for(U(1) << C.levels, [&](U i)
+    {
+        for (U j = 0; j < (U(1) << C.levels); j++)
+        {
+            auto tile = C.tile(i, j);
+            U nr = std::min(tr, A.nRows - std::min(A.nRows, i * tr));
+            U nc = std::min(tc, A.nCols - std::min(A.nCols, j * tc));
+
+            if (nr && nc)
+                view_copy(A.block(i * tr, j * tc, nr, nc),
+                    tile.block(0, 0, nr, nc));
+
+            // The padding, if any.
+            view_set_to_zero(tile.block(0, nc, nr, tc - nc));
+            view_set_to_zero(tile.block(nr, 0, tr - nr, tc));
+        }
+    });
+}
+
+template<typename T>
+void view_from_Morton(MortonView<T> A, MatrixView<T> C)
+{
+    assert((C.nRows <= A.get_nRows()) && (C.nCols <= A.get_nCols()));
+
+    U tr = A.tile_rows;
+    U tc = A.tile_cols;
+
+    parallel_for(U(1) << A.levels, [&](U i)
+    {
+        for (U j = 0; j < (U(1) << A.levels); j++)
+        {
+            U nr = std::min(tr, C.nRows - std::min(C.nRows, i * tr));
+            U nc = std::min(tc, C.nCols - std::min(C.nCols, j * tc));
+
+            if (nr && nc)
+                view_copy(A.tile(i, j).block(0, 0, nr, nc),
+                    C.block(i * tr, j * tc, nr, nc));
+        }
+    });
+}
+
+// ----------------------------------------------------
+
+template<typename T>
+static void assert_shapes_match(MortonView<T> A, MortonView<T> B,
+    MortonView<T> C)
+{
+    assert((A.levels == B.levels) && (A.levels == C.levels));
+    assert(A.tile_cols == B.tile_rows);
+    assert((A.tile_rows == C.tile_rows) && (B.tile_cols == C.tile_cols));
+}
+
+template<typename T>
+void Morton_BB_multiply_add(MortonView<T> A, MortonView<T> B,
+    MortonView<T> C)
+{
+    assert_shapes_match(A, B, C);
+
+    if (!A.levels)
+    {
+        view_multiply_add(A.tile(), B.tile(), C.tile());
+        return;
+    }
+
+    TaskGroup group;
+
+    for (U x = 0; x < 2; x++)
+    {
+        for (U y = 0; y < 2; y++)
+        {
+            group.run([=]
+            {
+                Morton_BB_multiply_add(A.quadrant(x, 0), B.quadrant(0, y),
+                    C.quadrant(x, y));
+                Morton_BB_multiply_add(A.quadrant(x, 1), B.quadrant(1, y),
+                    C.quadrant(x, y));
+            });
+        }
+    }
+
+    group.wait();
+}
+
+// ----------------------------------------------------
+
+// Elementwise kernels on whole Morton views: with matching shapes, these are
+// single passes over contiguous arrays.
+
+template<typename T>
+static void Morton_add(MortonView<T> A, MortonView<T> B, MortonView<T> C)
+{
+    vector_add(A.get_num_elements(), A.data, B.data, C.data);
+}
+
+template<typename T>
+static void Morton_subtract(MortonView<T> A, MortonView<T> B,
+    MortonView<T> C)
+{
+    vector_sub(A.get_num_elements(), A.data, B.data, C.data);
+}
+
+// Number of elements in a Morton view, rounded up to whole 64-byte cache
+// lines, as Workspace::allocate_raw() requires.
+template<typename T>
+static U get_line_rounded_size(MortonView<T> X)
+{
+    U line = 64 / sizeof(T);
+    return ceil_div(X.get_num_elements(), line) * line;
+}
+
+// One level of Morton_SW_multiply() needs X (the S's, and then P1) and Y
+// (the T's), each the size of one quadrant, plus whatever the next level
+// needs.
+template<typename T>
+U get_Morton_SW_workspace_size(MortonView<T> A, MortonView<T> B)
+{
+    if (!A.levels)
+        return 0;
+
+    MortonView<T> C = { nullptr, A.levels, A.tile_rows, B.tile_cols };
+    auto A11 = A.quadrant(0, 0);
+    auto B11 = B.quadrant(0, 0);
+
+    return std::max(get_line_rounded_size(A11),
+                    get_line_rounded_size(C.quadrant(0, 0)))
+        + get_line_rounded_size(B11)
+        + get_Morton_SW_workspace_size(A11, B11);
+}
+
+// The steps of SW_step() (matrix.cpp), on Morton quadrants.
+template<typename T>
+void Morton_SW_multiply(MortonView<T> A, MortonView<T> B, MortonView<T> C,
+    Workspace<T>& ws)
+{
+    assert_shapes_match(A, B, C);
+
+    if (!A.levels)
+    {
+        view_set_to_zero(C.tile());
+        view_multiply_add(A.tile(), B.tile(), C.tile());
+        return;
+    }
+
+    auto A11 = A.quadrant(0, 0), A12 = A.quadrant(0, 1);
+    auto A21 = A.quadrant(1, 0), A22 = A.quadrant(1, 1);
+    auto B11 = B.quadrant(0, 0), B12 = B.quadrant(0, 1);
+    auto B21 = B.quadrant(1, 0), B22 = B.quadrant(1, 1);
+    auto C11 = C.quadrant(0, 0), C12 = C.quadrant(0, 1);
+    auto C21 = C.quadrant(1, 0), C22 = C.quadrant(1, 1);
+
+    U mark = ws.get_used();
+
+    // X holds the S's (shaped like A11), and then P1 (shaped like C11).
+    T* x = ws.allocate_raw(std::max(get_line_rounded_size(A11),
+                                    get_line_rounded_size(C11)));
+    MortonView<T> X = { x, A11.levels, A11.tile_rows, A11.tile_cols };
+    MortonView<T> P1 = { x, C11.levels, C11.tile_rows, C11.tile_cols };
+    MortonView<T> Y = B11;
+    Y.data = ws.allocate_raw(get_line_rounded_size(B11));
+
+    auto recurse = [&](MortonView<T> A, MortonView<T> B, MortonView<T> C)
+    {
+        Morton_SW_multiply(A, B, C, ws);
+    };
+
+    Morton_subtract(A11, A21, X);           // X   = S3
+    Morton_subtract(B22, B12, Y);           // Y   = T3
+    recurse(X, Y, C21);                     // C21 = P7 = S3 * T3
+
+    Morton_add(A21, A22, X);                // X   = S1
+    Morton_subtract(B12, B11, Y);           // Y   = T1
+    recurse(X, Y, C22);                     // C22 = P5 = S1 * T1
+
+    Morton_subtract(X, A11, X);             // X   = S2 = S1 - A11
+    Morton_subtract(B22, Y, Y);             // Y   = T2 = B22 - T1
+    recurse(X, Y, C12);                     // C12 = P6 = S2 * T2
+
+    Morton_subtract(A12, X, X);             // X   = S4 = A12 - S2
+    recurse(X, B22, C11);                   // C11 = P3 = S4 * B22
+
+    recurse(A11, B11, P1);                  // X   = P1 = A11 * B11
+
+    Morton_add(P1, C12, C12);               // C12 = U2 = P1 + P6
+    Morton_add(C12, C21, C21);              // C21 = U3 = U2 + P7
+    Morton_add(C12, C22, C12);              // C12 = U4 = U2 + P5
+    Morton_add(C21, C22, C22);              // C22 = U7 = U3 + P5  (final)
+    Morton_add(C12, C11, C12);              // C12 = U5 = U4 + P3  (final)
+
+    Morton_subtract(Y, B21, Y);             // Y   = T4 = T2 - B21
+    recurse(A22, Y, C11);                   // C11 = P4 = A22 * T4
+    Morton_subtract(C21, C11, C21);         // C21 = U6 = U3 - P4  (final)
+
+    recurse(A12, B21, C11);                 // C11 = P2 = A12 * B21
+    Morton_add(P1, C11, C11);               // C11 = U1 = P1 + P2  (final)
+
+    ws.release(mark);
+}
+
+// ----------------------------------------------------
+
+// Morton copies of A, B, and C, carved off one workspace, which also holds
+// the temporaries of the multiply (if any).
+template<typename T>
+struct MortonOperands
+{
+    MortonView<T> A, B, C;
+    Workspace<T> ws;
+
+    MortonOperands(MatrixView<T> A_rm, MatrixView<T> B_rm, U levels,
+        U extra_size = 0)
+        : A(make_Morton_view<T>(nullptr, A_rm.nRows, A_rm.nCols, levels)),
+          B(make_Morton_view<T>(nullptr, B_rm.nRows, B_rm.nCols, levels)),
+          C(make_Morton_view<T>(nullptr, A_rm.nRows, B_rm.nCols, levels)),
+          ws(get_line_rounded_size(A) + get_line_rounded_size(B)
+              + get_line_rounded_size(C) + extra_size)
+    {
+        A.data = ws.allocate_raw(get_line_rounded_size(A));
+        B.data = ws.allocate_raw(get_line_rounded_size(B));
+        C.data = ws.allocate_raw(get_line_rounded_size(C));
+
+        view_to_Morton(A_rm, A);
+        view_to_Morton(B_rm, B);
+    }
+};
+
+template<typename T>
+void view_Morton_BB_multiply_add(MatrixView<T> A, MatrixView<T> B,
+    MatrixView<T> C)
+{
+    assert(A.nCols == B.nRows);
+    assert((A.nRows == C.nRows) && (B.nCols == C.nCols));
+
+    U levels = get_Morton_levels(A.nRows, A.nCols, B.nCols,
+        get_BB_leaf_size());
+    MortonOperands<T> op(A, B, levels);
+
+    view_to_Morton(C, op.C);
+    Morton_BB_multiply_add(op.A, op.B, op.C);
+    view_from_Morton(op.C, C);
+}
+
+template<typename T>
+void view_Morton_SW_multiply(MatrixView<T> A, MatrixView<T> B,
+    MatrixView<T> C)
+{
+    assert(A.nCols == B.nRows);
+    assert((A.nRows == C.nRows) && (B.nCols == C.nCols));
+
+    U levels = get_Morton_levels(A.nRows, A.nCols, B.nCols,
+        get_SB_leaf_size());
+    U ws_size = get_Morton_SW_workspace_size(
+        make_Morton_view<T>(nullptr, A.nRows, A.nCols, levels),
+        make_Morton_view<T>(nullptr, B.nRows, B.nCols, levels));
+    MortonOperands<T> op(A, B, levels, ws_size);
+
+    Morton_SW_multiply(op.A, op.B, op.C, op.ws);
+    view_from_Morton(op.C, C);
+}
@@ -1,4 +1,18 @@
 #include "matrix.h"
+#include "allocation.h"
+#include "bilinear.h"
+#include "compare.h"
+#include "expression.h"
+#include "gemm.h"
+#include "layout.h"
+#include "matrix_file.h"
+#include "numa.h"
+#include "out_of_core.h"
+#include "perf.h"
+#include "random.h"
+#include "thread_pool.h"
+#include "verify.h"
+#include "workspace.h"
 
 // settings for matrix sizes
 U AR = 3;   // number of rows in A
@@ -13,10 +27,19 @@ int UB = 30; // upper bound for data entries
 // other settings
 double TOLERANCE = 0.0000000001;
 
+// Above this size, the tests of the recursive algorithms skip the O(n^3)
+// textbook reference, and verify their results with Freivalds' O(n^2) check
+// (see verify.h) alone.
+U MAX_REFERENCE_SIZE = 1024;
+
 // do not modify: values derived from above variables
 U BR = AC;      // do not edit: number of rows in B == number of cols in A
 int LB = -UB;   // do not edit: lower bound == -(upper bound)
 
+// Strassen-Winograd's error bound is larger than Strassen's, so compare its
+// results with a looser tolerance.
+double SW_TOLERANCE = 10 * TOLERANCE;
+
 // ----------------------------------------------------
 
 static void Print_usage_and_exit(const char* argv[],
@@ -26,7 +49,7 @@ static void Print_usage_and_exit(const char* argv[],
         fprintf(stderr, "Error: %s\n\n", error_msg);
 
     fprintf(stderr,
-        "Usage: %s [-h | <XP> <UB>]\n"
+        "Usage: %s [-h | <XP> <UB> [<LEAF> [<THREADS>]]]\n"
         "Options:\n"
         "* -h = this help message\n"
         "* <XP> = exponent\n"
@@ -34,8 +57,15 @@ static void Print_usage_and_exit(const char* argv[],
         "  - 2**<XP> will be the number of rows/columns in test matrices\n"
         "* <UB> = upper bound\n"
         "  - must be a positive integer between 1 and 1000\n"
-        "  - the contents of the test matrices will range from -UB to UB\n",
-        argv[0]);
+        "  - the contents of the test matrices will range from -UB to UB\n"
+        "* <LEAF> = Strassen leaf size\n"
+        "  - must be a positive integer\n"
+        "  - Strassen recursion stops at <LEAF> x <LEAF> blocks\n"
+        "  - defaults to %zu\n"
+        "* <THREADS> = number of threads\n"
+        "  - must be a positive integer\n"
+        "  - defaults to %zu (the number of hardware threads)\n",
+        argv[0], get_SB_leaf_size(), get_num_threads());
 
     exit (error_msg == nullptr);
 }
@@ -53,7 +83,7 @@ static void Process_ARGV(int argc, const char* argv[])
         Print_usage_and_exit(argv,
             (argc == 2) ? nullptr : "Too many arguments");
 
-    if (argc != 3)
+    if ((argc < 3) || (argc > 5))
         Print_usage_and_exit(argv,
             "Incorrect arguments: Expected to find <XP> and <UB>");
 
@@ -62,7 +92,7 @@ static void Process_ARGV(int argc, const char* argv[])
         Print_usage_and_exit(argv,
             "Incorrect argument: <XP> out of range");
 
-    MULT_AR = 1 << exponent;
+    MULT_AR = U(1) << exponent;
 
     UB = atoi(argv[2]);
     if ((UB <= 0) || (UB > 1000))
@@ -71,10 +101,31 @@ static void Process_ARGV(int argc, const char* argv[])
 
     LB = -UB;
 
+    if (argc >= 4)
+    {
+        int leaf = atoi(argv[3]);
+        if (leaf <= 0)
+            Print_usage_and_exit(argv,
+                "Incorrect argument: <LEAF> out of range");
+
+        set_SB_leaf_size(leaf);
+    }
+
+    if (argc >= 5)
+    {
+        int threads = atoi(argv[4]);
+        if (threads <= 0)
+            Print_usage_and_exit(argv,
+                "Incorrect argument: <THREADS> out of range");
+
+        set_num_threads(threads);
+    }
+
     printf(
-        "We will use 2**%d x 2**%d matrices,"
-        " with contents ranging from %d to %d.\n----\n",
-        exponent, exponent, LB, UB);
+        "We will use 2**%zu x 2**%zu matrices,"
+        " with contents ranging from %d to %d,"
+        " a Strassen leaf size of %zu, and %zu threads.\n----\n",
+        exponent, exponent, LB, UB, get_SB_leaf_size(), get_num_threads());
 }
 
 // ----------------------------------------------------
@@ -106,6 +157,15 @@ bool test_equals(const Matrix<T>* m1, const Matrix<T>* m2, string s1, string s2,
     return cmp_status;
 }
 
+// Report whether a condition, described by `label`, holds.
+bool test_check(bool condition, string label)
+{
+    printf("Check %s: %s.\n----\n", label.c_str(),
+        (condition ? "passed" : "failed"));
+
+    return condition;
+}
+
 
 // ----------------------------------------------------
 
@@ -262,11 +322,21 @@ void test_BB_multiply()
     M2->set_to_random(LB, UB);
     M2->display("M2", true);
 
-    auto P1 = M1->TB_multiply(M2)->display("P1 (Textbook M1 * M2)", true);
     auto P2 = M1->BB_multiply(M2)->display("P2 (Block-based M1 * M2)", true);
+    test_check(verify_product(M1, M2, P2),
+        "Freivalds: P2 (Block-based M1 * M2)");
+
+    if (MULT_AR <= MAX_REFERENCE_SIZE)
+    {
+        auto P1 = M1->TB_multiply(M2)->display("P1 (Textbook M1 * M2)", true);
+        test_equals(P1, P2,
+            "P1 (Textbook M1 * M2)", "P2 (Block-based M1 * M2)", TOLERANCE);
+        delete P1;
+    }
 
-    test_equals(P1, P2,
-        "P1 (Textbook M1 * M2)", "P2 (Block-based M1 * M2)", TOLERANCE);
+    delete M1;
+    delete M2;
+    delete P2;
 }
 
 // ----------------------------------------------------
@@ -282,11 +352,1204 @@ void test_SB_multiply()
     M2->set_to_random(LB, UB);
     M2->display("M2", true);
 
-    auto P1 = M1->TB_multiply(M2)->display("P1 (Textbook M1 * M2)", true);
     auto P2 = M1->SB_multiply(M2)->display("P2 (Strassen M1 * M2)", true);
+    test_check(verify_product(M1, M2, P2), "Freivalds: P2 (Strassen M1 * M2)");
+
+    if (MULT_AR <= MAX_REFERENCE_SIZE)
+    {
+        auto P1 = M1->TB_multiply(M2)->display("P1 (Textbook M1 * M2)", true);
+        test_equals(P1, P2,
+            "P1 (Textbook M1 * M2)", "P2 (Strassen M1 * M2)", TOLERANCE);
+        delete P1;
+    }
+
+    delete M1;
+    delete M2;
+    delete P2;
+}
+
+// ----------------------------------------------------
+
+// Compare multiply() (the packed GEMM) with TB_multiply() (the reference)
+// on shapes that do not line up with the kernel's register tiles or cache
+// blocks.  Repeat for each microkernel that this CPU can run.
+template<typename T>
+void test_multiply()
+{
+    const U shapes[][3] = {
+        { 1, 1, 1 }, { 3, 5, 4 }, { 7, 13, 5 }, { 9, 33, 37 },
+        { 150, 300, 70 } };
+
+    ISA saved_ISA = get_gemm_ISA();
+
+    for (int isa = (int) ISA::SCALAR; isa <= (int) get_best_ISA(); isa++)
+    {
+        set_gemm_ISA((ISA) isa);
+
+        for (const auto& shape : shapes)
+        {
+            auto M1 = new Matrix<T>(shape[0], shape[1]);
+            M1->set_to_random(LB, UB);
+
+            auto M2 = new Matrix<T>(shape[1], shape[2]);
+            M2->set_to_random(LB, UB);
+
+            auto P1 = M1->TB_multiply(M2);
+            auto P2 = M1->multiply(M2);
+
+            string label = "P2 (" + string(get_ISA_name((ISA) isa))
+                + " GEMM M1 * M2, "
+                + to_string(shape[0]) + "x" + to_string(shape[1]) + " * "
+                + to_string(shape[1]) + "x" + to_string(shape[2]) + ")";
+            test_equals(P1, P2, "P1 (Textbook M1 * M2)", label, TOLERANCE);
+
+            for (auto m : { M1, M2, P1, P2 })
+                delete m;
+        }
+    }
+
+    set_gemm_ISA(saved_ISA);
+}
+
+// ----------------------------------------------------
+
+// Exercise a recursive algorithm at every depth, from "multiply at the top
+// level" down to "recurse all the way to 1x1 blocks".
+template<typename T>
+void test_leaf_sizes(string name,
+    Matrix<T>* (Matrix<T>::*algorithm)(const Matrix<T>*) const,
+    U (*get_leaf_size)(), void (*set_leaf_size)(U))
+{
+    auto M1 = new Matrix<T>(MULT_AR, MULT_AR);
+    M1->set_to_random(LB, UB);
+
+    auto M2 = new Matrix<T>(MULT_AR, MULT_AR);
+    M2->set_to_random(LB, UB);
+
+    // Without the reference, check with Freivalds' check alone, and stop at
+    // leaves of 64: below that, the recursion itself takes O(n^3) time.
+    bool has_reference = (MULT_AR <= MAX_REFERENCE_SIZE);
+    auto P1 = has_reference ? M1->TB_multiply(M2) : nullptr;
+    U min_leaf = has_reference ? 1 : 64;
+
+    U saved_leaf_size = get_leaf_size();
+
+    for (U leaf = MULT_AR; leaf >= min_leaf; leaf /= 2)
+    {
+        set_leaf_size(leaf);
+
+        auto P2 = (M1->*algorithm)(M2);
+
+        string label =
+            "P2 (" + name + " M1 * M2, leaf " + to_string(leaf) + ")";
+        if (has_reference)
+            test_equals(P1, P2, "P1 (Textbook M1 * M2)", label, TOLERANCE);
+        else
+            test_check(verify_product(M1, M2, P2), "Freivalds: " + label);
+
+        delete P2;
+    }
+
+    set_leaf_size(saved_leaf_size);
+
+    delete M1;
+    delete M2;
+    delete P1;
+}
+
+template<typename T>
+void test_BB_leaf_sizes()
+{
+    test_leaf_sizes<T>("Block-based", &Matrix<T>::BB_multiply,
+        get_BB_leaf_size, set_BB_leaf_size);
+}
+
+template<typename T>
+void test_SB_leaf_sizes()
+{
+    test_leaf_sizes<T>("Strassen", &Matrix<T>::SB_multiply,
+        get_SB_leaf_size, set_SB_leaf_size);
+}
+
+template<typename T>
+void test_SW_leaf_sizes()
+{
+    test_leaf_sizes<T>("Strassen-Winograd", &Matrix<T>::SW_multiply,
+        get_SB_leaf_size, set_SB_leaf_size);
+}
+
+// ----------------------------------------------------
+
+// Compare each algorithm, run on several threads, with the (serial)
+// reference.  Use small leaves, so that there are many parallel tasks.
+template<typename T>
+void test_parallel_multiply()
+{
+    const U size = 256;
+
+    auto M1 = new Matrix<T>(size, size);
+    M1->set_to_random(LB, UB);
+
+    auto M2 = new Matrix<T>(size, size);
+    M2->set_to_random(LB, UB);
+
+    U saved_num_threads = get_num_threads();
+    U saved_BB_leaf_size = get_BB_leaf_size();
+    U saved_SB_leaf_size = get_SB_leaf_size();
+
+    set_num_threads(1);
+    auto P1 = M1->TB_multiply(M2);
+
+    set_num_threads(4);
+    set_BB_leaf_size(32);
+    set_SB_leaf_size(32);
+
+    auto P2 = M1->TB_multiply(M2);
+    test_equals(P1, P2, "P1 (Textbook M1 * M2)",
+        "P2 (4-thread Textbook M1 * M2)");
+
+    auto P3 = M1->multiply(M2);
+    test_equals(P1, P3, "P1 (Textbook M1 * M2)",
+        "P3 (4-thread GEMM M1 * M2)", TOLERANCE);
+
+    auto P4 = M1->BB_multiply(M2);
+    test_equals(P1, P4, "P1 (Textbook M1 * M2)",
+        "P4 (4-thread Block-based M1 * M2)", TOLERANCE);
+
+    // Strassen, with tasks spawned at none, some, and all levels.
+    U saved_SB_parallel_depth = get_SB_parallel_depth();
+
+    for (U depth = 0; depth <= 3; depth++)
+    {
+        set_SB_parallel_depth(depth);
+
+        auto P5 = M1->SB_multiply(M2);
+        test_equals(P1, P5, "P1 (Textbook M1 * M2)",
+            "P5 (4-thread Strassen M1 * M2, parallel depth "
+                + to_string(depth) + ")", TOLERANCE);
+
+        delete P5;
+    }
+
+    auto P6 = M1->SW_multiply(M2);
+    test_equals(P1, P6, "P1 (Textbook M1 * M2)",
+        "P6 (4-thread Strassen-Winograd M1 * M2)", SW_TOLERANCE);
+
+    // A task that throws: the others still run, and wait() rethrows.
+    std::atomic<U> num_run(0);
+    bool rethrown = false;
+    try
+    {
+        TaskGroup group;
+        for (U i = 0; i < 16; i++)
+            group.run([&num_run, i]
+            {
+                num_run++;
+                if (i == 5)
+                    throw std::runtime_error("task 5");
+            });
+        group.wait();
+    }
+    catch(std::runtime_error &e)
+    {
+        rethrown = (string(e.what()) == "task 5");
+    }
+    test_check(rethrown && (num_run == 16),
+        "TaskGroup: wait() rethrows a task's exception, after all 16 tasks");
+
+    set_num_threads(saved_num_threads);
+    set_BB_leaf_size(saved_BB_leaf_size);
+    set_SB_leaf_size(saved_SB_leaf_size);
+    set_SB_parallel_depth(saved_SB_parallel_depth);
+
+    for (auto m : { M1, M2, P1, P2, P3, P4, P6 })
+        delete m;
+}
+
+// ----------------------------------------------------
+
+// Test thread pinning: each thread slot runs once, on its own CPU, and the
+// statically partitioned paths (first touch, and gemm()) give the same
+// results as the work-stealing ones.
+template<typename T>
+void test_affinity()
+{
+    const U size = 768;
+
+    U saved_num_threads = get_num_threads();
+    set_num_threads(4);
+
+    printf("NUMA nodes: %zu\n----\n", get_num_numa_nodes());
+
+    auto M1 = new Matrix<T>(size, size);
+    M1->set_to_random(LB, UB);
+
+    auto M2 = new Matrix<T>(size, size);
+    M2->set_to_random(LB, UB);
+
+    auto P1 = M1->multiply(M2);
+
+    for (Affinity affinity : { Affinity::Compact, Affinity::Scatter })
+    {
+        set_thread_affinity(affinity);
+        string name = get_affinity_name(affinity);
+
+        std::vector<U> runs(get_num_threads(), 0);
+        std::vector<int> cpus(get_num_threads(), -1);
+        std::vector<U> slot_counts(get_num_threads(), 0);
+        parallel_for_each_thread([&](U slot, U num_slots)
+        {
+            runs[slot]++;
+            slot_counts[slot] = num_slots;
+#ifdef __linux__
+            cpus[slot] = sched_getcpu();
+#else
+            cpus[slot] = get_thread_cpu(slot);
+#endif
+        });
+
+        bool each_once = true;
+        bool on_own_cpu = true;
+        for (U slot = 0; slot < runs.size(); slot++)
+        {
+            each_once = each_once && (runs[slot] == 1)
+                && (slot_counts[slot] == get_num_threads());
+            on_own_cpu = on_own_cpu && (cpus[slot] == get_thread_cpu(slot));
+        }
+        test_check(each_once, name + " affinity: each thread slot runs once,"
+            " and sees the number of slots");
+        test_check(on_own_cpu, name + " affinity: each slot on its own CPU");
+
+        // Large enough to be first-touched in parallel.
+        Matrix<T> m3(*M1);
+        test_equals(M1, &m3, "M1", "m3 (copy of M1, " + name + " affinity)");
+
+        auto P2 = M1->multiply(M2);
+        test_equals(P1, P2, "P1 (GEMM M1 * M2)",
+            "P2 (4-thread GEMM M1 * M2, " + name + " affinity)", TOLERANCE);
+        delete P2;
+    }
+
+    set_thread_affinity(Affinity::None);
+    set_num_threads(saved_num_threads);
+
+    for (auto m : { M1, M2, P1 })
+        delete m;
+}
+
+// ----------------------------------------------------
+
+// Test copying, moving, and the operators, including buffer reuse.
+template<typename T>
+void test_value_semantics()
+{
+    const U size = 64;
+
+    Matrix<T> m1(size, size);
+    m1.set_to_random(LB, UB);
+
+    Matrix<T> m2(m1);
+    test_equals(&m1, &m2, "m1", "m2 (copy of m1)");
+    test_check(m1.get_data() != m2.get_data(), "copy has its own buffer");
+
+    T* m2_data = m2.get_data();
+    Matrix<T> m3(std::move(m2));
+    test_check((m3.get_data() == m2_data) && (m2.get_data() == nullptr)
+        && (m2.get_nRows() == 0), "move transfers the buffer");
+
+    m2 = m3;
+    test_equals(&m1, &m2, "m1", "m2 (assigned from m3)");
+
+    // A temporary's buffer is reused along a chain of operators.
+    Matrix<T> sum = m1 + m3;
+    T* sum_data = sum.get_data();
+    Matrix<T> m4 = -(std::move(sum) - m3 - m1 - m1);
+    test_check(m4.get_data() == sum_data, "operator chain reuses the buffer");
+    test_equals(&m1, &m4, "m1", "m4 (-((m1 + m3) - m3 - m1 - m1))");
+
+    m4 += m1;
+    m4 -= m3;
+    test_equals(&m1, &m4, "m1", "m4 (m4 + m1 - m3)");
+
+    auto P1 = m1.multiply(&m3);
+    Matrix<T> P2 = m1 * m3;
+    test_equals(P1, &P2, "P1 (GEMM m1 * m3)", "P2 (m1 * m3)");
+    delete P1;
+
+    // Shrinking keeps the buffer.
+    T* m4_data = m4.get_data();
+    Matrix<T> small(size / 2, size / 4);
+    small.set_to_random(LB, UB);
+    m4.set_to_copy(&small);
+    test_equals(&small, &m4, "small", "m4 (copy of small)");
+    U m4_capacity = m4.get_capacity();
+    m4.set_to_identity(size / 2);
+    test_check((m4.get_data() == m4_data) && (m4.get_capacity() == m4_capacity),
+        "set_to_copy() and set_to_identity() reuse the buffer");
+}
+
+// ----------------------------------------------------
+
+// Test the storage of matrices: aligned buffers, with rows padded away from
+// power-of-two strides, and the same results with and without the padding.
+template<typename T>
+void test_padding()
+{
+    const U size = 256;
+
+    Matrix<T> m1(size, size);
+    m1.set_to_random(LB, UB);
+    Matrix<T> m2(size, size);
+    m2.set_to_random(LB, UB);
+
+    U line = 64 / sizeof(T);
+    test_check(!(reinterpret_cast<uintptr_t>(m1.get_data()) % 64),
+        "buffer is 64-byte aligned");
+    test_check((m1.get_ld() > size) && !(m1.get_ld() % line)
+        && ((m1.get_ld() / line) % 2), "rows padded to an odd number of lines: "
+            + to_string(size) + " -> " + to_string(m1.get_ld()));
+    test_check(Matrix<T>(size, 10).get_ld() == 10, "short rows are not padded");
+
+    // Large buffers are mapped on huge-page boundaries (Linux only), and
+    // indexed with 64-bit arithmetic.
+    Matrix<T> large(1024, 1024);
+#ifdef __linux__
+    test_check(!(reinterpret_cast<uintptr_t>(large.get_data()) % (2 << 20)),
+        "large buffer is 2 MB aligned");
+#endif
+    test_check(sizeof(U) == 8, "sizes and indices are 64-bit");
+
+    // Unpadded copies.
+    set_pad_rows(false);
+    Matrix<T> u1(m1);
+    Matrix<T> u2(m2);
+    set_pad_rows(true);
+
+    test_check(u1.get_ld() == size, "unpadded copy has ld == nCols");
+    test_equals(&m1, &u1, "m1 (padded)", "u1 (unpadded copy of m1)");
+
+    auto P1 = u1.multiply(&u2);
+    Matrix<T> sum = m1 + m2;
+    Matrix<T> u_sum = u1 + u2;
+    test_equals(&u_sum, &sum, "u1 + u2 (unpadded)", "m1 + m2 (padded)");
+
+    for (auto m : { m1.multiply(&m2), m1.SB_multiply(&m2) })
+    {
+        test_equals(P1, m, "P1 (GEMM u1 * u2, unpadded)",
+            "m1 * m2 (padded)", TOLERANCE);
+        delete m;
+    }
+
+    auto P2 = m1.SW_multiply(&m2);
+    test_equals(P1, P2, "P1 (GEMM u1 * u2, unpadded)",
+        "P2 (Strassen-Winograd m1 * m2, padded)", SW_TOLERANCE);
+
+    delete P1;
+    delete P2;
+}
+
+// ----------------------------------------------------
+
+// Test Freivalds' check: it accepts correct products, from each algorithm,
+// and rejects a product with a single wrong element, or a swapped block.
+template<typename T>
+void test_verify()
+{
+    const U m = 300, k = 200, n = 250;
+
+    auto M1 = new Matrix<T>(m, k);
+    M1->set_to_random(LB, UB);
+
+    auto M2 = new Matrix<T>(k, n);
+    M2->set_to_random(LB, UB);
+
+    auto P1 = M1->TB_multiply(M2);
+    test_check(verify_product(M1, M2, P1), "Freivalds: textbook product");
+
+    for (auto P2 : { M1->multiply(M2), M1->SB_multiply(M2),
+        M1->SW_multiply(M2) })
+    {
+        test_check(verify_product(M1, M2, P2), "Freivalds: fast product");
+        delete P2;
+    }
+
+    // Rounding-sized errors pass; anything larger does not.
+    Matrix<T> P3(*P1);
+    T small = std::is_integral<T>::value ? 0 : T(1e-12);
+    P3.set_IJ(m / 2, n / 3, P3.get_IJ(m / 2, n / 3) + small);
+    test_check(verify_product(M1, M2, &P3),
+        "Freivalds: rounding error accepted");
+
+    P3.set_IJ(m / 2, n / 3, P3.get_IJ(m / 2, n / 3) + 1);
+    test_check(!verify_product(M1, M2, &P3),
+        "Freivalds: one wrong element rejected");
+
+    // Two rows swapped, as if a block were misplaced.
+    Matrix<T> P4(*P1);
+    for (U j = 0; j < n; j++)
+    {
+        T x = P4.get_IJ(0, j);
+        P4.set_IJ(0, j, P4.get_IJ(1, j));
+        P4.set_IJ(1, j, x);
+    }
+    test_check(!verify_product(M1, M2, &P4),
+        "Freivalds: swapped rows rejected");
+
+    for (auto m : { M1, M2, P1 })
+        delete m;
+}
+
+// ----------------------------------------------------
+
+// Test comparison with tolerances, and its report: the largest errors, where
+// they are, and how many elements are out of tolerance.
+template<typename T>
+void test_compare()
+{
+    const U size = 300;
+
+    Matrix<T> m1(size, size);
+    m1.set_to_random(LB, UB);
+    Matrix<T> m2(m1);
+
+    ComparisonReport report = m1.compare(&m2, Tolerance());
+    test_check(report.passed() && (report.max_absolute.error == 0)
+        && (report.num_mismatches == 0), "compare: copies are equal");
+
+    // Two perturbed elements: the larger error is the one reported.
+    m2.set_IJ(7, 11, m2.get_IJ(7, 11) + 1);
+    m2.set_IJ(size - 1, size / 2, m2.get_IJ(size - 1, size / 2) - 3);
+    report = m1.compare(&m2, Tolerance());
+    test_check(!report.passed() && (report.num_mismatches == 2)
+        && (report.max_absolute.error == 3)
+        && (report.max_absolute.row == size - 1)
+        && (report.max_absolute.col == size / 2),
+        "compare: largest error, its location, and the count");
+
+    Tolerance t;
+    t.absolute = 3;
+    test_check(m1.compare(&m2, t).passed(), "compare: absolute tolerance");
+    t.absolute = 2;
+    test_check(m1.compare(&m2, t).num_mismatches == 1,
+        "compare: absolute tolerance, one left out");
+
+    // Relative to max(|a|, |b|): any error up to 2 * max is within 2.
+    t = Tolerance();
+    t.relative = 2;
+    test_check(m1.compare(&m2, t).passed(), "compare: relative tolerance");
+
+    Matrix<T> m3(size, size + 1);
+    test_check(!m1.compare(&m3, Tolerance()).passed()
+        && !m1.compare(&m3, Tolerance()).dimensions_match,
+        "compare: dimensions differ");
+
+    if (!std::is_floating_point<T>::value)
+        return;
+
+    // One ULP apart: within 1 ULP, but not equal, and not within 1e-20
+    // relative.
+    Matrix<T> m4(m1);
+    T x = m4.get_IJ(5, 5);
+    m4.set_IJ(5, 5, std::nextafter(x, x + 1));
+
+    t = Tolerance();
+    t.ulps = 1;
+    test_check(m1.compare(&m4, t).passed()
+        && (m1.compare(&m4, t).max_ulps.error == 1),
+        "compare: one ULP apart, within 1 ULP");
+    t.ulps = 0;
+    t.relative = 1e-20;
+    test_check(!m1.compare(&m4, t).passed(),
+        "compare: one ULP apart, not within 1e-20 relative");
+
+    // A NaN is out of any tolerance, with an infinite error.
+    m4.set_IJ(9, 3, std::numeric_limits<T>::quiet_NaN());
+    t.absolute = 1e300;
+    report = m1.compare(&m4, t);
+    test_check(!report.passed() && (report.num_mismatches == 1)
+        && std::isinf(report.max_absolute.error)
+        && (report.max_absolute.row == 9) && (report.max_absolute.col == 3),
+        "compare: NaN out of tolerance");
+}
+
+// ----------------------------------------------------
+
+// Test the matrix file format: round trips through save and mmap, in both
+// layouts, and the rejection of corrupt and mistyped files.
+template<typename T>
+void test_matrix_file()
+{
+    const U m = 300, n = 250;
+    const string path = "/tmp/matrix_file_test_" + to_string(sizeof(T));
+
+    Matrix<T> m1(m, n);
+    m1.set_to_random(LB, UB);
+    test_check(save_matrix(&m1, path), "matrix file: saved");
+
+    auto mapped = MappedMatrix<T>::open(path);
+    test_check(mapped != nullptr, "matrix file: mapped");
+    if (!mapped)
+        return;
+
+    MatrixView<T> v = mapped->view();
+    test_check((v.ld == m1.get_ld())
+        && !((uintptr_t) v.data % mapped->get_header().alignment),
+        "matrix file: rows keep their stride, and the payload its alignment");
+    test_check(view_compare(m1.view(), v, Tolerance()).passed()
+        && mapped->verify_checksum(), "matrix file: mapped contents");
+
+    // As an operand, in place.
+    Matrix<T> M2(n, m);
+    M2.set_to_random(LB, UB);
+    Matrix<T> P1(m, m);
+    P1.set_to_zero();
+    view_multiply_add(v, M2.view(), P1.view());
+    auto P2 = m1.multiply(&M2);
+    test_check(P1.equals(P2, TOLERANCE), "matrix file: mapped operand");
+    delete P2;
+    delete mapped;
+
+    auto m2 = load_matrix<T>(path);
+    test_check(m2 && m1.equals(m2), "matrix file: loaded");
+    delete m2;
+
+    // Morton order.
+    U levels = 2;
+    std::vector<T> buffer(get_Morton_size(m, n, levels));
+    auto mv = make_Morton_view(buffer.data(), m, n, levels);
+    view_to_Morton(m1.view(), mv);
+    test_check(Morton_save_matrix(mv, path), "matrix file: Morton saved");
+
+    mapped = MappedMatrix<T>::open(path);
+    Matrix<T> m3(m, n);
+    if (mapped && (mapped->get_layout() == Layout::Morton))
+        view_from_Morton(mapped->Morton_view(), m3.view());
+    test_check(mapped && mapped->verify_checksum() && m1.equals(&m3),
+        "matrix file: Morton round trip");
+    delete mapped;
+
+    // One flipped bit, in the last element.
+    FILE* file = fopen(path.c_str(), "r+b");
+    fseek(file, -1, SEEK_END);
+    int c = fgetc(file);
+    fseek(file, -1, SEEK_END);
+    fputc(c ^ 1, file);
+    fclose(file);
+
+    mapped = MappedMatrix<T>::open(path);
+    test_check(mapped && !mapped->verify_checksum(),
+        "matrix file: corruption detected");
+    delete mapped;
+
+    // A file of the other element type.
+    save_matrix(&m1, path);
+    printf("Expect an error for the wrong element type:\n");
+    if (std::is_integral<T>::value)
+        test_check(!MappedMatrix<double>::open(path),
+            "matrix file: wrong type rejected");
+    else
+        test_check(!MappedMatrix<int>::open(path),
+            "matrix file: wrong type rejected");
+
+    std::remove(path.c_str());
+}
+
+// ----------------------------------------------------
+
+// Test the out-of-core multiply, with a budget small enough to cut each
+// dimension into several tiles, ragged at the edges.
+template<typename T>
+void test_out_of_core()
+{
+    const U m = 300, k = 200, n = 250;
+    const string path = "/tmp/out_of_core_test_" + to_string(sizeof(T));
+
+    auto M1 = new Matrix<T>(m, k);
+    M1->set_to_random(LB, UB);
+    auto M2 = new Matrix<T>(k, n);
+    M2->set_to_random(LB, UB);
+    save_matrix(M1, path + "_A");
+    save_matrix(M2, path + "_B");
+
+    U budget = get_out_of_core_memory<T>(64, 64, 64);
+    OutOfCoreStats stats;
+    test_check(out_of_core_multiply<T>(path + "_A", path + "_B", path + "_C",
+        budget, &stats), "out of core: multiplied");
+    test_check((stats.tile_rows == 64) && (stats.tile_inner == 64)
+        && (stats.tile_cols == 64),
+        "out of core: 64 x 64 tiles within the budget");
+
+    // load_matrix() checks the checksum, accumulated as the tiles went out.
+    auto P1 = M1->multiply(M2);
+    auto P2 = load_matrix<T>(path + "_C");
+    test_check(P2 && P1->equals(P2, TOLERANCE), "out of core: product");
+
+    // Room for the whole multiply: one tile each.
+    test_check(out_of_core_multiply<T>(path + "_A", path + "_B", path + "_C",
+        1 << 30, &stats) && (stats.tile_rows == m) && (stats.tile_cols == n),
+        "out of core: one tile");
+
+    printf("Expect errors for a dimension mismatch, and a budget of zero:\n");
+    test_check(!out_of_core_multiply<T>(path + "_A", path + "_A",
+        path + "_C", budget), "out of core: dimension mismatch rejected");
+    test_check(!out_of_core_multiply<T>(path + "_A", path + "_B",
+        path + "_C", 0), "out of core: budget too small rejected");
+
+    for (string suffix : { "_A", "_B", "_C" })
+        std::remove((path + suffix).c_str());
+
+    delete P2;
+    for (auto m : { M1, M2, P1 })
+        delete m;
+}
+
+// ----------------------------------------------------
+
+// Test the counter-based random fill: the generator against the published
+// known answers, and the fill's independence from threads and padding.
+template<typename T>
+void test_random()
+{
+    const U size = 300;
+    const U seed = 12345;
+
+    // Source: the known-answer tests of the Random123 library.
+    auto r = philox4x32({ 0, 0, 0, 0 }, { 0, 0 });
+    test_check((r[0] == 0x6627e8d5) && (r[1] == 0xe169c58d)
+        && (r[2] == 0xbc57ac4c) && (r[3] == 0x9b00dbd8),
+        "Philox4x32-10 known answer");
+
+    U saved_num_threads = get_num_threads();
+
+    set_num_threads(1);
+    Matrix<T> m1(size, size);
+    m1.set_to_random(LB, UB, seed);
+
+    set_num_threads(4);
+    Matrix<T> m2(size, size);
+    m2.set_to_random(LB, UB, seed);
+
+    set_pad_rows(false);
+    Matrix<T> m3(size, size);
+    m3.set_to_random(LB, UB, seed);
+    set_pad_rows(true);
+
+    set_num_threads(saved_num_threads);
+
+    test_equals(&m1, &m2, "m1 (1 thread)", "m2 (4 threads, same seed)");
+    test_equals(&m1, &m3, "m1 (padded)", "m3 (unpadded, same seed)");
+
+    Matrix<T> m4(size, size);
+    m4.set_to_random(LB, UB, seed + 1);
+    Matrix<T> m5(size, size);
+    m5.set_to_random(LB, UB);
+    Matrix<T> m6(size, size);
+    m6.set_to_random(LB, UB);
+    test_check(!m1.equals(&m4) && !m5.equals(&m6),
+        "different seeds give different contents");
+
+    // In range, and centered.
+    bool in_range = true;
+    double sum = 0;
+    for (U i = 0; i < size; i++)
+    {
+        for (U j = 0; j < size; j++)
+        {
+            T x = m1.get_IJ(i, j);
+            in_range = in_range && (x >= LB) && (x <= UB);
+            sum += x;
+        }
+    }
+    double mean = sum / (size * size);
+    test_check(in_range, "random values in [LB, UB]");
+    test_check(std::abs(mean) < 0.05 * UB,
+        "random values centered: mean " + to_string(mean));
+}
+
+// ----------------------------------------------------
+
+// Test the memory accounting of matrices and workspaces.
+template<typename T>
+void test_memory_stats()
+{
+    const U size = 512;
+
+    auto m1 = new Matrix<T>(size, size);
+    m1->set_to_random(LB, UB);
+    auto m2 = new Matrix<T>(size, size);
+    m2->set_to_random(LB, UB);
+
+    set_memory_stats_enabled(true);
+
+    U bytes = size * m1->get_ld() * sizeof(T);
+    auto m3 = new Matrix<T>(*m1);
+    MemoryStats stats = get_memory_stats();
+    test_check((stats.allocations == 1)
+        && (stats.live_bytes == (std::ptrdiff_t) bytes)
+        && (stats.peak_bytes == bytes), "memory stats: one matrix allocated");
+    test_check(stats.copied_bytes == size * size * sizeof(T),
+        "memory stats: copy counted");
+
+    // Larger, so resize() reallocates.
+    m3->set_to_identity(2 * size);
+    delete m3;
+    stats = get_memory_stats();
+    test_check((stats.allocations == 2) && (stats.frees == 2)
+        && (stats.live_bytes == 0) && (stats.peak_bytes > bytes),
+        "memory stats: identity reallocates, and all is freed");
+
+    auto m4 = assemble<T>(m1, m2, m2, m1);
+    stats = get_memory_stats();
+    test_check(stats.copied_bytes == (1 + 4) * size * size * sizeof(T),
+        "memory stats: assemble() copies four blocks");
+    delete m4;
+
+    // Strassen's products and operand sums come from its workspace, which
+    // is freed on return, leaving only C.
+    reset_memory_stats();
+    auto P1 = m1->SB_multiply(m2);
+    stats = get_memory_stats();
+    test_check((stats.live_bytes == (std::ptrdiff_t) bytes)
+        && (stats.peak_bytes > bytes),
+        "memory stats: SB_multiply() peak " + to_string(stats.peak_bytes)
+            + " bytes, result " + to_string(bytes) + " bytes");
+
+    set_memory_stats_enabled(false);
+    auto P2 = m1->multiply(m2);
+    test_check(get_memory_stats().allocations == 0,
+        "memory stats: nothing counted when off");
+
+    for (auto m : { m1, m2, P1, P2 })
+        delete m;
+}
+
+// ----------------------------------------------------
+
+// Test fused expressions against the equivalent chains of operations, on
+// whole matrices, on quadrants (non-contiguous views), and in place.
+template<typename T>
+void test_expressions()
+{
+    const U size = 64;
+
+    Matrix<T> m1(size), m2(size), m3(size), m4(size);
+    for (auto m : { &m1, &m2, &m3, &m4 })
+        m->set_to_random(LB, UB);
+
+    Matrix<T> e1(size);
+    view_assign(e1.view(), expr(m1) + expr(m2) - expr(m3) + -expr(m4));
+    Matrix<T> p1 = m1 + m2 - m3 + -m4;
+    test_equals(&p1, &e1, "p1 (m1 + m2 - m3 + -m4)", "e1 (fused)");
+
+    // Quadrants: e2[1][1] = m1[0][0] - m2[0][1] - m3[1][0], in place.
+    U s2 = size / 2;
+    Matrix<T> e2(m1);
+    view_assign(e2.view().quadrant(1, 1), expr(m1.view().quadrant(0, 0))
+        - expr(m2.view().quadrant(0, 1)) - expr(m3.view().quadrant(1, 0)));
+    view_assign(e2.view().quadrant(1, 1),
+        expr(e2.view().quadrant(1, 1)) + expr(m4.view().quadrant(1, 1)));
+
+    auto q = m1.get_block(s2, 0, 0);
+    for (auto b : { m2.get_block(s2, 0, s2), m3.get_block(s2, s2, 0) })
+    {
+        q->set_to_difference(b);
+        delete b;
+    }
+    auto b = m4.get_block(s2, s2, s2);
+    q->set_to_sum(b);
+
+    Matrix<T> p2(m1);
+    p2.set_block_to_copy(q, s2, s2, s2);
+    test_equals(&p2, &e2, "p2 (quadrant chain)", "e2 (fused quadrants)");
+
+    // A linear combination in which C appears twice, between other terms:
+    // e3 = 2 e3 + m1 - e3 + 3 m2, i.e. e3 + m1 + 3 m2.
+    Matrix<T> e3(m3);
+    const T coefficients[] = { 2, 1, -1, 3 };
+    const MatrixView<T> terms[] = { e3.view(), m1.view(), e3.view(),
+        m2.view() };
+    view_linear_combination(4, coefficients, terms, e3.view());
+    Matrix<T> p3 = m3 + m1 + m2 + m2 + m2;
+    test_equals(&p3, &e3, "p3 (m3 + m1 + 3 m2)",
+        "e3 (linear combination, C twice)", TOLERANCE);
+
+    delete q;
+    delete b;
+}
+
+// ----------------------------------------------------
+
+// Test Strassen with a caller-owned workspace: the result must not change,
+// the predicted size must be exactly the peak usage, and the workspace must
+// be reusable across multiplies.
+template<typename T>
+void test_SB_workspace()
+{
+    const U size = 256;
+
+    auto M1 = new Matrix<T>(size, size);
+    M1->set_to_random(LB, UB);
+
+    auto M2 = new Matrix<T>(size, size);
+    M2->set_to_random(LB, UB);
+
+    auto P1 = M1->TB_multiply(M2);
+
+    U saved_num_threads = get_num_threads();
+    U saved_SB_leaf_size = get_SB_leaf_size();
+    set_SB_leaf_size(32);
+
+    for (U num_threads : { 1, 4 })
+    {
+        set_num_threads(num_threads);
+
+        U ws_size = get_SB_workspace_size<T>(size);
+        Workspace<T> ws(ws_size);
+
+        for (U i = 1; i <= 2; i++)
+        {
+            auto P2 = new Matrix<T>(size, size);
+            view_SB_multiply(M1->view(), M2->view(), P2->view(), ws);
+
+            test_equals(P1, P2, "P1 (Textbook M1 * M2)",
+                "P2 (" + to_string(num_threads) + "-thread Strassen M1 * M2, "
+                    + "workspace use #" + to_string(i) + ")", TOLERANCE);
+
+            delete P2;
+        }
+
+        test_check((ws.get_used() == 0) && (ws.get_peak() == ws_size),
+            to_string(num_threads) + "-thread Strassen workspace: predicted "
+                + to_string(ws_size) + ", peak " + to_string(ws.get_peak()));
+    }
+
+    set_num_threads(saved_num_threads);
+    set_SB_leaf_size(saved_SB_leaf_size);
+
+    for (auto m : { M1, M2, P1 })
+        delete m;
+}
+
+// ----------------------------------------------------
+
+// Test Strassen-Winograd with a caller-owned workspace, as for Strassen.
+template<typename T>
+void test_SW_workspace()
+{
+    const U size = 256;
+
+    auto M1 = new Matrix<T>(size, size);
+    M1->set_to_random(LB, UB);
+
+    auto M2 = new Matrix<T>(size, size);
+    M2->set_to_random(LB, UB);
+
+    auto P1 = M1->TB_multiply(M2);
+
+    U saved_SB_leaf_size = get_SB_leaf_size();
+    set_SB_leaf_size(32);
+
+    U ws_size = get_SW_workspace_size<T>(size);
+    Workspace<T> ws(ws_size);
+
+    auto P2 = new Matrix<T>(size, size);
+    view_SW_multiply(M1->view(), M2->view(), P2->view(), ws);
+
+    test_equals(P1, P2, "P1 (Textbook M1 * M2)",
+        "P2 (Strassen-Winograd M1 * M2, caller's workspace)", SW_TOLERANCE);
+    test_check((ws.get_used() == 0) && (ws.get_peak() == ws_size),
+        "Strassen-Winograd workspace: predicted " + to_string(ws_size)
+            + ", peak " + to_string(ws.get_peak()));
+
+    set_SB_leaf_size(saved_SB_leaf_size);
+
+    for (auto m : { M1, M2, P1, P2 })
+        delete m;
+}
+
+// ----------------------------------------------------
+
+// Test the recursive algorithms on sizes that are not powers of 2, and on
+// rectangular shapes, with a small leaf size, so that the peeling and the
+// splitting happen at many levels.  With a caller-owned workspace, Strassen
+// and Strassen-Winograd must also use exactly the predicted workspace.
+template<typename T>
+void test_any_shape()
+{
+    struct Shape { U m, k, n; };
+    const Shape shapes[] = {
+        { 1, 1, 1 }, { 7, 5, 3 }, { 33, 17, 65 }, { 100, 37, 250 },
+        { 127, 129, 131 }, { 150, 225, 100 }, { 2, 500, 3 }
+    };
+
+    U saved_num_threads = get_num_threads();
+    U saved_BB_leaf_size = get_BB_leaf_size();
+    U saved_SB_leaf_size = get_SB_leaf_size();
+    set_BB_leaf_size(8);
+    set_SB_leaf_size(8);
+
+    for (U num_threads : { 1, 4 })
+    {
+        set_num_threads(num_threads);
+
+        for (auto shape : shapes)
+        {
+            string dims = to_string(shape.m) + "x" + to_string(shape.k)
+                + "x" + to_string(shape.n) + ", "
+                + to_string(num_threads) + "-thread";
+
+            auto M1 = new Matrix<T>(shape.m, shape.k);
+            M1->set_to_random(LB, UB);
+
+            auto M2 = new Matrix<T>(shape.k, shape.n);
+            M2->set_to_random(LB, UB);
+
+            auto P1 = M1->TB_multiply(M2);
+
+            auto P2 = M1->BB_multiply(M2);
+            test_equals(P1, P2, "P1 (Textbook M1 * M2)",
+                "P2 (Block-based M1 * M2, " + dims + ")", TOLERANCE);
+
+            auto P3 = new Matrix<T>(shape.m, shape.n);
+
+            U ws_size = get_SB_workspace_size<T>(shape.m, shape.k, shape.n);
+            Workspace<T> ws(ws_size);
+            view_SB_multiply(M1->view(), M2->view(), P3->view(), ws);
+            test_equals(P1, P3, "P1 (Textbook M1 * M2)",
+                "P3 (Strassen M1 * M2, " + dims + ")", TOLERANCE);
+            test_check(ws.get_peak() == ws_size,
+                "Strassen workspace, " + dims + ": predicted "
+                    + to_string(ws_size) + ", peak "
+                    + to_string(ws.get_peak()));
+
+            U sw_ws_size = get_SW_workspace_size<T>(shape.m, shape.k, shape.n);
+            Workspace<T> sw_ws(sw_ws_size);
+            view_SW_multiply(M1->view(), M2->view(), P3->view(), sw_ws);
+            test_equals(P1, P3, "P1 (Textbook M1 * M2)",
+                "P3 (Strassen-Winograd M1 * M2, " + dims + ")", SW_TOLERANCE);
+            test_check(sw_ws.get_peak() == sw_ws_size,
+                "Strassen-Winograd workspace, " + dims + ": predicted "
+                    + to_string(sw_ws_size) + ", peak "
+                    + to_string(sw_ws.get_peak()));
+
+            for (auto m : { M1, M2, P1, P2, P3 })
+                delete m;
+        }
+    }
+
+    set_num_threads(saved_num_threads);
+    set_BB_leaf_size(saved_BB_leaf_size);
+    set_SB_leaf_size(saved_SB_leaf_size);
+}
+
+// ----------------------------------------------------
+
+// Test the Morton layout: conversion both ways, with padding, and the Morton
+// forms of the block-based and Strassen-Winograd multiplies, on the shapes of
+// test_any_shape().
+template<typename T>
+void test_Morton()
+{
+    Matrix<T> m1(100, 37);
+    m1.set_to_random(LB, UB);
+
+    const U levels = 3;
+    std::vector<T> buffer(get_Morton_size(100, 37, levels));
+    auto mv = make_Morton_view(buffer.data(), 100, 37, levels);
+    test_check((mv.tile_rows == 13) && (mv.tile_cols == 5)
+        && (mv.get_num_elements() == buffer.size()),
+        "Morton grid for 100x37, 3 levels: 8x8 tiles of 13x5");
+
+    view_to_Morton(m1.view(), mv);
+    test_check(mv.tile(5, 2).at(3, 4) == m1.get_IJ(5 * 13 + 3, 2 * 5 + 4),
+        "tile [5][2] holds block [65..77][10..14]");
+    test_check(mv.quadrant(1, 0).quadrant(0, 1).data == mv.tile(4, 2).data,
+        "quadrant [1][0][0][1] starts at tile [4][2]");
+
+    Matrix<T> m2(100, 37);
+    view_from_Morton(mv, m2.view());
+    test_equals(&m1, &m2, "m1", "m2 (m1 to Morton and back)");
+
+    struct Shape { U m, k, n; };
+    const Shape shapes[] = {
+        { 1, 1, 1 }, { 7, 5, 3 }, { 33, 17, 65 }, { 100, 37, 250 },
+        { 127, 129, 131 }, { 150, 225, 100 }, { 2, 500, 3 }
+    };
+
+    U saved_BB_leaf_size = get_BB_leaf_size();
+    U saved_SB_leaf_size = get_SB_leaf_size();
+    set_BB_leaf_size(8);
+    set_SB_leaf_size(8);
+
+    for (auto shape : shapes)
+    {
+        string dims = to_string(shape.m) + "x" + to_string(shape.k)
+            + "x" + to_string(shape.n);
+
+        auto M1 = new Matrix<T>(shape.m, shape.k);
+        M1->set_to_random(LB, UB);
+
+        auto M2 = new Matrix<T>(shape.k, shape.n);
+        M2->set_to_random(LB, UB);
+
+        auto P1 = M1->TB_multiply(M2);
+
+        auto P2 = M1->BB_multiply(M2, Layout::Morton);
+        test_equals(P1, P2, "P1 (Textbook M1 * M2)",
+            "P2 (Morton block-based M1 * M2, " + dims + ")", TOLERANCE);
+
+        auto P3 = M1->SW_multiply(M2, Layout::Morton);
+        test_equals(P1, P3, "P1 (Textbook M1 * M2)",
+            "P3 (Morton Strassen-Winograd M1 * M2, " + dims + ")",
+            SW_TOLERANCE);
+
+        for (auto m : { M1, M2, P1, P2, P3 })
+            delete m;
+    }
+
+    set_BB_leaf_size(saved_BB_leaf_size);
+    set_SB_leaf_size(saved_SB_leaf_size);
+}
+
+// ----------------------------------------------------
+
+// Test the bilinear schemes: their tables must satisfy the Brent equations
+// (and a wrong table must not), and the engine must match Textbook, with
+// one scheme at every level, or different schemes at different levels.
+template<typename T>
+void test_BL_multiply()
+{
+    auto Strassen = BilinearScheme::Strassen();
+    auto Winograd = BilinearScheme::Winograd();
+    auto classical_323 = BilinearScheme::classical(3, 2, 3);
+    auto Strassen_424 = BilinearScheme::classical(2, 1, 2).compose(Strassen);
+
+    for (auto scheme : { Strassen, Winograd, classical_323, Strassen_424,
+        Strassen.compose(Winograd) })
+    {
+        test_check(scheme.satisfies_Brent_equations(),
+            scheme.get_name() + " satisfies the Brent equations");
+    }
+
+    BilinearScheme doubling("doubling", 1, 1, 1, 1, { 1 }, { 1 }, { 2 });
+    test_check(!doubling.satisfies_Brent_equations(),
+        doubling.get_name() + " does not satisfy the Brent equations");
+
+    struct Shape { U m, k, n; };
+    const Shape shapes[] = { { 64, 64, 64 }, { 150, 100, 150 }, { 97, 61, 130 } };
+
+    const BilinearSchemes scheme_lists[] = {
+        { Strassen }, { Winograd }, { classical_323 },
+        { Strassen_424, Strassen }
+    };
+
+    U saved_num_threads = get_num_threads();
+    U saved_SB_leaf_size = get_SB_leaf_size();
+    set_SB_leaf_size(8);
+
+    for (U num_threads : { 1, 4 })
+    {
+        set_num_threads(num_threads);
+
+        for (auto shape : shapes)
+        {
+            auto M1 = new Matrix<T>(shape.m, shape.k);
+            M1->set_to_random(LB, UB);
+
+            auto M2 = new Matrix<T>(shape.k, shape.n);
+            M2->set_to_random(LB, UB);
+
+            auto P1 = M1->TB_multiply(M2);
+            auto P2 = new Matrix<T>(shape.m, shape.n);
+
+            for (auto& schemes : scheme_lists)
+            {
+                string label = schemes[0].get_name();
+                for (U i = 1; i < schemes.size(); i++)
+                    label += ", then " + schemes[i].get_name();
+
+                label += "; " + to_string(shape.m) + "x" + to_string(shape.k)
+                    + "x" + to_string(shape.n) + ", "
+                    + to_string(num_threads) + "-thread";
+
+                U ws_size = get_BL_workspace_size<T>(shape.m, shape.k,
+                    shape.n, schemes);
+                Workspace<T> ws(ws_size);
+                view_BL_multiply(M1->view(), M2->view(), P2->view(), schemes,
+                    ws);
+
+                test_equals(P1, P2, "P1 (Textbook M1 * M2)",
+                    "P2 (Bilinear M1 * M2: " + label + ")", SW_TOLERANCE);
+                test_check(ws.get_peak() == ws_size,
+                    "Bilinear workspace (" + label + "): predicted "
+                        + to_string(ws_size) + ", peak "
+                        + to_string(ws.get_peak()));
+            }
+
+            auto P3 = M1->BL_multiply(M2, { Strassen });
+            test_equals(P1, P3, "P1 (Textbook M1 * M2)",
+                "P3 (Bilinear M1 * M2: Strassen, via BL_multiply())",
+                TOLERANCE);
+
+            for (auto m : { M1, M2, P1, P2, P3 })
+                delete m;
+        }
+    }
+
+    set_num_threads(saved_num_threads);
+    set_SB_leaf_size(saved_SB_leaf_size);
+}
+
+// ----------------------------------------------------
+
+// Test the performance counters, via PerfScope (which PERF_SCOPE() wraps, when
+// PERF_COUNTERS is set).
+template<typename T>
+void test_perf_counters()
+{
+    const U size = 256;
+
+    reset_perf_counts();
+
+    auto M1 = new Matrix<T>(size, size);
+    M1->set_to_random(LB, UB);
+
+    auto M2 = new Matrix<T>(size, size);
+    M2->set_to_random(LB, UB);
+
+    Matrix<T>* P1;
+    {
+        PerfScope outer(PerfPhase::SB_products);
+        {
+            PerfScope inner(PerfPhase::SB_sums);
+            view_add(M1->view(), M2->view(), M1->view());
+        }
+        P1 = M1->multiply(M2);
+    }
+
+    PerfCounts outer = get_perf_counts(PerfPhase::SB_products);
+    PerfCounts inner = get_perf_counts(PerfPhase::SB_sums);
+
+    test_check((outer.calls == 1) && (inner.calls == 1),
+        "performance counters: one call of each phase");
+    test_check(outer.nanoseconds > inner.nanoseconds,
+        "performance counters: the multiply outlasts the sum");
+
+    // Without a PMU (e.g. in a VM), the counters read as zero.
+    if (is_perf_available())
+        test_check(outer.instructions > inner.instructions,
+            "performance counters: the multiply outnumbers the sum");
+    else
+        printf("Hardware performance counters are unavailable.\n----\n");
+
+    print_perf_report();
+
+    reset_perf_counts();
+    test_check(get_perf_counts(PerfPhase::SB_products).calls == 0,
+        "performance counters: reset");
 
-    test_equals(P1, P2,
-        "P1 (Textbook M1 * M2)", "P2 (Strassen M1 * M2)", TOLERANCE);
+    for (auto m : { M1, M2, P1 })
+        delete m;
 }
 
 // ----------------------------------------------------
@@ -299,15 +1562,64 @@ int main(int argc, const char* argv[])
     //test_basic_ops<int>();
     //test_basic_ops_blocks<int>();
     //test_assemble<int>();
+    test_multiply<int>();
     //test_BB_multiply<int>();
+    test_BB_leaf_sizes<int>();
     //test_SB_multiply<int>();
+    test_SB_leaf_sizes<int>();
+    test_SW_leaf_sizes<int>();
+    test_parallel_multiply<int>();
+    test_affinity<int>();
+    test_value_semantics<int>();
+    test_padding<int>();
+    test_memory_stats<int>();
+    test_random<int>();
+    test_verify<int>();
+    test_compare<int>();
+    test_matrix_file<int>();
+    test_out_of_core<int>();
+    test_expressions<int>();
+    test_SB_workspace<int>();
+    test_SW_workspace<int>();
+    test_any_shape<int>();
+    test_Morton<int>();
+    test_BL_multiply<int>();
 
     // Tests for operations on `double` matrices.
     //test_basic_ops<double>();
     //test_basic_ops_blocks<double>();
     //test_assemble<double>();
+    test_multiply<double>();
     //test_BB_multiply<double>();
+    test_BB_leaf_sizes<double>();
     test_SB_multiply<double>();
+    test_SB_leaf_sizes<double>();
+    test_SW_leaf_sizes<double>();
+    test_parallel_multiply<double>();
+    test_affinity<double>();
+    test_value_semantics<double>();
+    test_padding<double>();
+    test_memory_stats<double>();
+    test_random<double>();
+    test_verify<double>();
+    test_compare<double>();
+    test_matrix_file<double>();
+    test_out_of_core<double>();
+    test_expressions<double>();
+    test_SB_workspace<double>();
+    test_SW_workspace<double>();
+    test_any_shape<double>();
+    test_Morton<double>();
+    test_BL_multiply<double>();
+
+#if PERF_COUNTERS
+    // The phases of all of the tests above.
+    print_perf_report();
+#endif
+
+    // These reset the counts, so they come last.
+    test_perf_counters<int>();
+    test_perf_counters<double>();
 
     return 0;
 }
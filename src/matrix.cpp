@@ -1,4 +1,15 @@
 #include "matrix.h"
+#include "allocation.h"
+#include "bilinear.h"
+#include "compare.h"
+#include "expression.h"
+#include "gemm.h"
+#include "layout.h"
+#include "numa.h"
+#include "perf.h"
+#include "random.h"
+#include "thread_pool.h"
+#include "workspace.h"
 
 using Mx_int = Matrix<int>;
 using Mx_dbl = Matrix<double>;
@@ -16,6 +27,49 @@ Mx_int* assemble(Mx_int* m11, Mx_int* m12, Mx_int* m21, Mx_int* m22);
 template
 Mx_dbl* assemble(Mx_dbl* m11, Mx_dbl* m12, Mx_dbl* m21, Mx_dbl* m22);
 
+template
+void view_BB_multiply_add(MatrixView<int> A, MatrixView<int> B,
+    MatrixView<int> C);
+template
+void view_BB_multiply_add(MatrixView<double> A, MatrixView<double> B,
+    MatrixView<double> C);
+
+template
+void view_SB_multiply(MatrixView<int> A, MatrixView<int> B,
+    MatrixView<int> C, Workspace<int>& ws);
+template
+void view_SB_multiply(MatrixView<double> A, MatrixView<double> B,
+    MatrixView<double> C, Workspace<double>& ws);
+template
+void view_SB_multiply(MatrixView<int> A, MatrixView<int> B,
+    MatrixView<int> C);
+template
+void view_SB_multiply(MatrixView<double> A, MatrixView<double> B,
+    MatrixView<double> C);
+
+template U get_SB_workspace_size<int>(U size);
+template U get_SB_workspace_size<double>(U size);
+template U get_SB_workspace_size<int>(U m, U k, U n);
+template U get_SB_workspace_size<double>(U m, U k, U n);
+
+template
+void view_SW_multiply(MatrixView<int> A, MatrixView<int> B,
+    MatrixView<int> C, Workspace<int>& ws);
+template
+void view_SW_multiply(MatrixView<double> A, MatrixView<double> B,
+    MatrixView<double> C, Workspace<double>& ws);
+template
+void view_SW_multiply(MatrixView<int> A, MatrixView<int> B,
+    MatrixView<int> C);
+template
+void view_SW_multiply(MatrixView<double> A, MatrixView<double> B,
+    MatrixView<double> C);
+
+template U get_SW_workspace_size<int>(U size);
+template U get_SW_workspace_size<double>(U size);
+template U get_SW_workspace_size<int>(U m, U k, U n);
+template U get_SW_workspace_size<double>(U m, U k, U n);
+
 // ----------------------------------------------------
 
 template<typename T>
@@ -30,7 +84,12 @@ void Matrix<T>::construct(U nr, U nc)
 
         nRows = nr;
         nCols = nc;
-        data  = new T[nRows * nCols];
+        ld    = get_padded_ld<T>(nc);
+        data  = allocate_aligned<T>(nRows * ld);
+        capacity = nRows * ld;
+
+        if (is_placed_by_first_touch(capacity * sizeof(T)))
+            view_first_touch(MatrixView<T>{ data, nRows, ld, ld });
     }
     catch(std::exception &e)
     {
@@ -44,63 +103,95 @@ void Matrix<T>::construct(U nr, U nc)
     }
 }
 
-// ----------------------------------------------------
+template<typename T>
+Matrix<T>::~Matrix()
+{
+    free_aligned(data, capacity);
+}
 
-static U get_num_discards()
+template<typename T>
+void Matrix<T>::resize(U nr, U nc)
 {
-    static U num_discards = 0;
-    static U step_up = 20;
+    U new_ld = get_padded_ld<T>(nc);
 
-    // If we used zero discards, or the same discard count each time, the
-    // contents of each matrix would start off at the same location in the
-    // pseudo-random sequence.
-    // e.g.: 7, 3, 5, 2, 4, 9, 8, 6, 1, 0, 3, 2, ...
-    // m1 = [ 7 3 5 | 2 4 9 | 8 6 1 ]
-    // m2 = [ 7 3 | 5 2 | 4 9 ]
+    if (nr * new_ld > capacity)
+    {
+        free_aligned(data, capacity);
+        data = allocate_aligned<T>(nr * new_ld);
+        capacity = nr * new_ld;
 
-    // To prevent this, each time we call get_num_discards(), we step up the
-    // number of items we are going to discard.
+        if (is_placed_by_first_touch(capacity * sizeof(T)))
+            view_first_touch(MatrixView<T>{ data, nr, new_ld, new_ld });
+    }
 
-    num_discards += step_up;
-    return num_discards;
+    nRows = nr;
+    nCols = nc;
+    ld = new_ld;
 }
 
-// Set each element of A to a random value.
-// Adapt the randomisation logic from
-// https://www.cplusplus.com/reference/random/
-// FYI: distribution(generator) generates a number in the range lower..upper
-template<>
-void Mx_int::set_to_random(int lower, int upper)
+// ----------------------------------------------------
+
+template<typename T>
+Matrix<T>::Matrix(const Matrix<T>& B)
+    : nRows(0), nCols(0), ld(0), data(nullptr), capacity(0)
 {
-    std::default_random_engine generator;
-    std::uniform_int_distribution<int> distribution(lower, upper);
+    set_to_copy(&B);
+}
 
-    // discard the first few generated items
-    U nDiscards = get_num_discards();
-    for (U i = 0; i < nDiscards; i++)
-        distribution(generator);
+template<typename T>
+Matrix<T>::Matrix(Matrix<T>&& B) noexcept
+    : nRows(B.nRows), nCols(B.nCols), ld(B.ld), data(B.data),
+      capacity(B.capacity)
+{
+    B.nRows = B.nCols = B.ld = B.capacity = 0;
+    B.data = nullptr;
+}
 
-    for (U i = 0; i < nRows; i++)
-        for (U j = 0; j < nCols; j++)
-            set_IJ(i, j, distribution(generator));
+template<typename T>
+Matrix<T>& Matrix<T>::operator=(const Matrix<T>& B)
+{
+    if (this != &B)
+        set_to_copy(&B);
+
+    return *this;
 }
 
-template<>
-void Mx_dbl::set_to_random(int lower, int upper)
+template<typename T>
+Matrix<T>& Matrix<T>::operator=(Matrix<T>&& B) noexcept
 {
-    std::default_random_engine generator;
-    std::uniform_real_distribution<double> distribution(lower, upper);
+    if (this != &B)
+    {
+        free_aligned(data, capacity);
 
-    // discard the first few generated items
-    U nDiscards = get_num_discards();
-    for (U i = 0; i < nDiscards; i++)
-        distribution(generator);
+        nRows = B.nRows;
+        nCols = B.nCols;
+        ld = B.ld;
+        data = B.data;
+        capacity = B.capacity;
 
-    for (U i = 0; i < nRows; i++)
-        for (U j = 0; j < nCols; j++)
-            set_IJ(i, j, distribution(generator));
+        B.nRows = B.nCols = B.ld = B.capacity = 0;
+        B.data = nullptr;
+    }
+
+    return *this;
+}
+
+// ----------------------------------------------------
+
+// Set each element of A to a random value, from a counter-based generator
+// (see random.h), so that the contents depend only on the seed, and not on
+// the number of threads that fill them.
+template<typename T>
+void Matrix<T>::set_to_random(int lower, int upper)
+{
+    set_to_random(lower, upper, get_next_random_seed());
 }
 
+template<typename T>
+void Matrix<T>::set_to_random(int lower, int upper, U seed)
+{
+    view_set_to_random(view(), lower, upper, seed);
+}
 
 // ----------------------------------------------------
 
@@ -122,7 +213,7 @@ void Matrix<T>::display_block(string label, U size,
     assert(nRows >= (init_row + size));
     assert(nCols >= (init_col + size));
 
-    printf("%s: %d x %d; size = %d; init = [%d, %d]\n",
+    printf("%s: %zu x %zu; size = %zu; init = [%zu, %zu]\n",
         label.c_str(), nRows, nCols, size, init_row, init_col);
 
     for (U i = 0; i < size; i++)
@@ -138,7 +229,7 @@ template<typename T>
 const Matrix<T>* Matrix<T>::display(string label /* = "{unknown matrix}" */,
     bool always_show_data /* = false */) const
 {
-    printf("%s: %d x %d\n", label.c_str(), nRows, nCols);
+    printf("%s: %zu x %zu\n", label.c_str(), nRows, nCols);
 
     // display the full matrix only for debug mode
     if (always_show_data || (DEBUG_LEVEL > 0))
@@ -173,7 +264,7 @@ const Matrix<T>* Matrix<T>::display(string label /* = "{unknown matrix}" */,
 template<typename T>
 void Matrix<T>::set_to_zero()
 {
-    memset(data, 0, nRows * nCols * sizeof(T));
+    view_set_to_zero(view());
 }
 
 
@@ -208,10 +299,7 @@ void Matrix<T>::set_to_identity()
 template<typename T>
 void Matrix<T>::set_to_identity(U n)
 {
-    delete [] data;
-
-    nRows = nCols = n;
-    data  = new T[nRows * nCols];
+    resize(n, n);
 
     set_to_zero();
 
@@ -224,13 +312,12 @@ void Matrix<T>::set_to_identity(U n)
 template<typename T>
 void Matrix<T>::set_to_copy(const Matrix<T>* B)
 {
-    delete [] data;
+    resize(B->get_nRows(), B->get_nCols());
 
-    nRows = B->get_nRows();
-    nCols = B->get_nCols();
-    data  = new T[nRows * nCols];
+    if (nRows && nCols)
+        view_copy(B->view(), view());
 
-    memcpy(data, B->get_data(), nRows * nCols * sizeof(T));
+    count_copied_bytes(nRows * nCols * sizeof(T));
 }
 
 // ----------------------------------------------------
@@ -246,10 +333,28 @@ void Matrix<T>::set_block_to_copy(const Matrix<T>* B, U size,
     assert(B->get_nRows() >= (init_row_B + size));
     assert(B->get_nCols() >= (init_col_B + size));
 
-    for (U i = 0; i < size; i++)
-        for (U j = 0; j < size; j++)
-            set_IJ(init_row_A + i, init_col_A + j,
-                B->get_IJ(init_row_B + i, init_col_B + j));
+    view_copy(B->block_view(size, init_row_B, init_col_B),
+        block_view(size, init_row_A, init_col_A));
+
+    count_copied_bytes(size * size * sizeof(T));
+}
+
+// ----------------------------------------------------
+
+template<typename T>
+void Matrix<T>::set_to_sum(const Matrix<T>* B)
+{
+    assert(dimensions_match(B));
+
+    view_add(view(), B->view(), view());
+}
+
+template<typename T>
+void Matrix<T>::set_to_difference(const Matrix<T>* B)
+{
+    assert(dimensions_match(B));
+
+    view_subtract(view(), B->view(), view());
 }
 
 // ----------------------------------------------------
@@ -264,7 +369,7 @@ bool Matrix<T>::dimensions_match(const Matrix<T>* B) const
 
     if ((AR != BR) || (AC != BC))
     {
-        DPRINTF(1)("dimension mismatch: A[%d,%d] and B[%d,%d]\n", AR, AC, BR, BC);
+        DPRINTF(1)("dimension mismatch: A[%zu,%zu] and B[%zu,%zu]\n", AR, AC, BR, BC);
         return false;
     }
 
@@ -277,24 +382,24 @@ bool Matrix<T>::dimensions_match(const Matrix<T>* B) const
 template<typename T> inline const char* GFS_equals1();
 template<> inline const char* GFS_equals1<int>()
 {
-    return "i = %d; j = %d; a = %d; b = %d; a - b = %d\n";
+    return "i = %zu; j = %zu; a = %d; b = %d; a - b = %d\n";
 }
 template<> inline const char* GFS_equals1<double>()
 {
-    return "i = %d; j = %d; a = %f; b = %f; a - b = %f\n";
+    return "i = %zu; j = %zu; a = %f; b = %f; a - b = %f\n";
 }
 
 // GFS_equals2 = GFS #2 for Matrix<T>::equals()
 template<typename T> inline const char* GFS_equals2();
 template<> inline const char* GFS_equals2<int>()
 {
-    return "* p1 = P1[%d][%d] = %d;\n* p2 = P2[%d][%d] = %d;\n* p1 - p2 = %d\n";
+    return "* p1 = P1[%zu][%zu] = %d;\n* p2 = P2[%zu][%zu] = %d;\n* p1 - p2 = %d\n";
 }
 template<> inline const char* GFS_equals2<double>()
 {
     return
-        "* p1 = P1[%d][%d] = %40.40f;\n"
-        "* p2 = P2[%d][%d] = %40.40f;\n"
+        "* p1 = P1[%zu][%zu] = %40.40f;\n"
+        "* p2 = P2[%zu][%zu] = %40.40f;\n"
         "* p1 - p2 = %40.40f\n";
 }
 
@@ -313,30 +418,33 @@ template<> inline const char* GFS_equals2<double>()
 template<typename T>
 bool Matrix<T>::equals(const Matrix<T>* B, double tolerance /* = 0 */) const
 {
-    if (!dimensions_match(B))
-        return false;
+    Tolerance t;
+    t.absolute = tolerance;
 
-    for (U i = 0; i < nRows; i++)
+    ComparisonReport report = compare(B, t);
+
+    // When `tolerance` is zero, I always (even in non-debug mode)
+    // want to show the largest difference.
+    // When `tolerance` is non-zero, I want to display diffs only in
+    // debug mode.
+    // DPRINTF(tolerance) achieves this.
+    if (report.dimensions_match && (report.max_absolute.error > 0))
     {
-        for (U j = 0; j < nCols; j++)
-        {
-            T a = get_IJ(i, j);
-            T b = B->get_IJ(i, j);
-
-            // When `tolerance` is zero, I always (even in non-debug mode)
-            // want to show the very first difference.
-            // When `tolerance` is non-zero, I want to display diffs only in
-            // debug mode.
-            // DPRINTF(tolerance) achieves this.
-            if (a != b)
-                DPRINTF(tolerance)(GFS_equals2<T>(), i, j, a, i, j, b, a - b);
-
-            if (abs(a - b) > tolerance)
-                return false;
-        }
+        U i = report.max_absolute.row;
+        U j = report.max_absolute.col;
+        T a = get_IJ(i, j);
+        T b = B->get_IJ(i, j);
+        DPRINTF(tolerance)(GFS_equals2<T>(), i, j, a, i, j, b, a - b);
     }
 
-    return true;
+    return report.passed();
+}
+
+template<typename T>
+ComparisonReport Matrix<T>::compare(const Matrix<T>* B,
+    const Tolerance& tolerance) const
+{
+    return view_compare(view(), B->view(), tolerance);
 }
 
 // ----------------------------------------------------
@@ -344,9 +452,7 @@ bool Matrix<T>::equals(const Matrix<T>* B, double tolerance /* = 0 */) const
 template<typename T>
 void Matrix<T>::set_to_negative()
 {
-    for (U i = 0; i < nRows; i++)
-        for (U j = 0; j < nCols; j++)
-            set_IJ(i, j, -get_IJ(i, j));
+    view_negate(view(), view());
 }
 
 // ----------------------------------------------------
@@ -356,10 +462,19 @@ Matrix<T>* Matrix<T>::get_negative() const
 {
     Matrix<T>* C = new Matrix<T>(nRows, nCols);
 
-    for (U i = 0; i < nRows; i++)
-        for (U j = 0; j < nCols; j++)
-            C->set_IJ(i, j, -get_IJ(i, j));
+    view_negate(view(), C->view());
+
+    return C;
+}
+
+// ----------------------------------------------------
 
+template<typename T>
+Matrix<T>* Matrix<T>::get_block(U size,
+    U init_row /* = 0 */, U init_col /* = 0 */) const
+{
+    Matrix<T>* C = new Matrix<T>(size, size);
+    C->set_block_to_copy(this, size, 0, 0, init_row, init_col);
     return C;
 }
 
@@ -393,16 +508,13 @@ Matrix<T>* Matrix<T>::helper_for_add_sub_blocks(bool isAddition,
 
         Matrix<T>* C = new Matrix<T>(size, size);
 
-        for (U i = 0; i < size; i++)
-        {
-            for (U j = 0; j < size; j++)
-            {
-                T a = get_IJ(init_row_A + i, init_col_A + j);
-                T b = B->get_IJ(init_row_B + i, init_col_B + j);
-                T sum = (isAddition ? (a + b) : (a - b));
-                C->set_IJ(i, j, sum);
-            }
-        }
+        auto A_block = block_view(size, init_row_A, init_col_A);
+        auto B_block = B->block_view(size, init_row_B, init_col_B);
+
+        if (isAddition)
+            view_add(A_block, B_block, C->view());
+        else
+            view_subtract(A_block, B_block, C->view());
 
         C->display_block((isAddition ? "X+Y" : "X-Y"), size);
         return C;
@@ -454,16 +566,10 @@ Matrix<T>* Matrix<T>::helper_for_add_sub(bool isAddition, const Matrix<T>* B) co
 
         Matrix<T>* C = new Matrix<T>(nRows, nCols);
 
-        for (U i = 0; i < nRows; i++)
-        {
-            for (U j = 0; j < nCols; j++)
-            {
-                T a = get_IJ(i, j);
-                T b = B->get_IJ(i, j);
-                T sum = (isAddition ? (a + b) : (a - b));
-                C->set_IJ(i, j, sum);
-            }
-        }
+        if (isAddition)
+            view_add(view(), B->view(), C->view());
+        else
+            view_subtract(view(), B->view(), C->view());
 
         return C;
     }
@@ -493,15 +599,77 @@ Matrix<T>* Matrix<T>::subtract(const Matrix<T>* B) const
 
 // ----------------------------------------------------
 
+template<typename T>
+Matrix<T> Matrix<T>::operator+(const Matrix<T>& B) const &
+{
+    assert(dimensions_match(&B));
+
+    Matrix<T> C(nRows, nCols);
+    view_add(view(), B.view(), C.view());
+    return C;
+}
+
+template<typename T>
+Matrix<T> Matrix<T>::operator+(const Matrix<T>& B) &&
+{
+    set_to_sum(&B);
+    return std::move(*this);
+}
+
+template<typename T>
+Matrix<T> Matrix<T>::operator-(const Matrix<T>& B) const &
+{
+    assert(dimensions_match(&B));
+
+    Matrix<T> C(nRows, nCols);
+    view_subtract(view(), B.view(), C.view());
+    return C;
+}
+
+template<typename T>
+Matrix<T> Matrix<T>::operator-(const Matrix<T>& B) &&
+{
+    set_to_difference(&B);
+    return std::move(*this);
+}
+
+template<typename T>
+Matrix<T> Matrix<T>::operator-() const &
+{
+    Matrix<T> C(nRows, nCols);
+    view_negate(view(), C.view());
+    return C;
+}
+
+template<typename T>
+Matrix<T> Matrix<T>::operator-() &&
+{
+    set_to_negative();
+    return std::move(*this);
+}
+
+template<typename T>
+Matrix<T> Matrix<T>::operator*(const Matrix<T>& B) const
+{
+    assert(nCols == B.get_nRows());
+
+    Matrix<T> C(nRows, B.get_nCols());
+    C.set_to_zero();
+    view_multiply_add(view(), B.view(), C.view());
+    return C;
+}
+
+// ----------------------------------------------------
+
 // GFS_multiply = GFS for Matrix<T>::multiply()
 template<typename T> inline const char* GFS_multiply();
 template<> inline const char* GFS_multiply<int>()
 {
-    return "a = A[%d][%d] = %d; b = B[%d][%d] = %d; a * b = %d; sum = %d\n";
+    return "a = A[%zu][%zu] = %d; b = B[%zu][%zu] = %d; a * b = %d; sum = %d\n";
 }
 template<> inline const char* GFS_multiply<double>()
 {
-    return "a = A[%d][%d] = %f; b = B[%d][%d] = %f; a * b = %f; sum = %f\n";
+    return "a = A[%zu][%zu] = %f; b = B[%zu][%zu] = %f; a * b = %f; sum = %f\n";
 }
 
 template<typename T>
@@ -525,30 +693,10 @@ Matrix<T>* Matrix<T>::multiply_blocks(const Matrix<T>* B, U size,
         B->display_block("Y", size, init_row_B, init_col_B);
 
         Matrix<T>* C = new Matrix<T>(size, size);
+        C->set_to_zero();
 
-        for (U i = 0; i < size; i++)
-        {
-            for (U k = 0; k < size; k++)
-            {
-                T sum = 0;
-
-                for (U j = 0; j < size; j++)
-                {
-                    T a = get_IJ(init_row_A + i, init_col_A + j);
-                    T b = B->get_IJ(init_row_B + j, init_col_B + k);
-                    T prod = a * b;
-                    sum += prod;
-                    DPRINTF(2)(GFS_multiply<T>(),
-                        init_row_A + i, init_col_A + j, a,
-                        init_row_B + j, init_col_B + k, b,
-                        prod, sum);
-                }
-
-                DPRINTF(2)("----\n");
-
-                C->set_IJ(i, k, sum);
-            }
-        }
+        view_multiply_add(block_view(size, init_row_A, init_col_A),
+            B->block_view(size, init_row_B, init_col_B), C->view());
 
         C->display_block("X*Y", size);
         return C;
@@ -570,7 +718,33 @@ Matrix<T>* Matrix<T>::multiply_blocks(const Matrix<T>* B, U size,
 template<typename T>
 Matrix<T>* Matrix<T>::multiply(const Matrix<T>* B) const
 {
-    return TB_multiply(B);
+    try
+    {
+        U AR = nRows;
+        U AC = nCols;
+        U BR = B->get_nRows();
+        U BC = B->get_nCols();
+
+        if (AC != BR)
+            throw std::invalid_argument( "multiply(): dimension mismatch" );
+
+        Matrix<T>* C = new Matrix<T>(AR, BC);
+        C->set_to_zero();
+
+        view_multiply_add(view(), B->view(), C->view());
+
+        return C;
+    }
+    catch(std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << "\n";
+        return nullptr;
+    }
+    catch(...)
+    {
+        std::cerr << "Error: Unknown problem\n";
+        return nullptr;
+    }
 }
 
 // ----------------------------------------------------
@@ -590,26 +764,35 @@ Matrix<T>* Matrix<T>::TB_multiply(const Matrix<T>* B) const
 
         Matrix<T>* C = new Matrix<T>(AR, BC);
 
-        for (U i = 0; i < AR; i++)
+        // Split the rows of C into a few tiles per thread.
+        U num_tiles = std::min(AR, 4 * get_num_threads());
+        U rows_per_tile = (AR + num_tiles - 1) / num_tiles;
+
+        parallel_for(num_tiles, [&](U tile)
         {
-            for (U k = 0; k < BC; k++)
-            {
-                T sum = 0;
+            U end_row = std::min(AR, (tile + 1) * rows_per_tile);
 
-                for (U j = 0; j < AC; j++)
+            for (U i = tile * rows_per_tile; i < end_row; i++)
+            {
+                for (U k = 0; k < BC; k++)
                 {
-                    T a = get_IJ(i, j);
-                    T b = B->get_IJ(j, k);
-                    T prod = a * b;
-                    sum += prod;
-                    DPRINTF(2)(GFS_multiply<T>(), i, j, a, j, k, b, prod, sum);
-                }
+                    T sum = 0;
+
+                    for (U j = 0; j < AC; j++)
+                    {
+                        T a = get_IJ(i, j);
+                        T b = B->get_IJ(j, k);
+                        T prod = a * b;
+                        sum += prod;
+                        DPRINTF(2)(GFS_multiply<T>(), i, j, a, j, k, b, prod, sum);
+                    }
 
-                DPRINTF(2)("----\n");
+                    DPRINTF(2)("----\n");
 
-                C->set_IJ(i, k, sum);
+                    C->set_IJ(i, k, sum);
+                }
             }
-        }
+        });
 
         return C;
     }
@@ -633,87 +816,776 @@ bool is_power_of_2(U n)
     return (n && !(n & (n - 1)));
 }
 
+// Leaf size for BB_multiply().
+// gemm() does its own blocking for L1/L2/L3, so the leaves only need to be
+// large enough to amortise its packing.
+static U BB_leaf_size = 256;
+
+U get_BB_leaf_size()
+{
+    return BB_leaf_size;
+}
+
+void set_BB_leaf_size(U n)
+{
+    assert(n >= 1);
+    BB_leaf_size = n;
+}
+
+// ----------------------------------------------------
+
+// Shapes:
+// The recursive algorithms below multiply an m x k block A by a k x n block
+// B, into an m x n block C.  Any m, k, and n are allowed.  Halving an odd
+// dimension gives blocks of (dim / 2) and (dim - dim / 2).
+
+// The dimension to split, when splitting a multiply into two.
+enum class Split { M, K, N };
+
+// Return the largest of m, k, and n.  Ties go to m, then n: splitting m or n
+// gives independent halves, while splitting k gives two products into the
+// same C.
+static Split get_largest_dimension(U m, U k, U n)
+{
+    if ((m >= k) && (m >= n))
+        return Split::M;
+    if (n >= k)
+        return Split::N;
+    return Split::K;
+}
+
+// C += A * B
+//
+// This is the cache-oblivious divide-and-conquer multiply: each level halves
+// the largest of the three dimensions, so at some level the blocks fit in
+// each level of the cache hierarchy, whatever its size, and whatever the
+// shape of the operands.  (For square operands, two levels split C into its
+// quadrants, and a third gives each quadrant its two products in turn.)
+// Products are accumulated into C, so no temporaries are needed.
+//
+// Source: M. Frigo, C. E. Leiserson, H. Prokop, S. Ramachandran,
+// "Cache-oblivious algorithms", FOCS 1999, section 2.
+//
+// The recursion doubles as the parallel decomposition: splitting m or n
+// spawns two tasks, which the thread pool spreads over the threads by work
+// stealing.  Splitting k does not, since both halves write all of C.
+template<typename T>
+void view_BB_multiply_add(MatrixView<T> A, MatrixView<T> B, MatrixView<T> C)
+{
+    U m = A.nRows;
+    U k = A.nCols;
+    U n = B.nCols;
+
+    assert(k == B.nRows);
+    assert((m == C.nRows) && (n == C.nCols));
+
+    if (std::max({m, k, n}) <= get_BB_leaf_size())
+    {
+        PERF_SCOPE(PerfPhase::BB_products);
+        view_multiply_add(A, B, C);
+        return;
+    }
+
+    TaskGroup group;
+
+    switch (get_largest_dimension(m, k, n))
+    {
+    case Split::M:
+    {
+        U h = m / 2;
+        group.run([=] { view_BB_multiply_add(A.block(0, 0, h, k), B,
+            C.block(0, 0, h, n)); });
+        group.run([=] { view_BB_multiply_add(A.block(h, 0, m - h, k), B,
+            C.block(h, 0, m - h, n)); });
+        break;
+    }
+    case Split::N:
+    {
+        U h = n / 2;
+        group.run([=] { view_BB_multiply_add(A, B.block(0, 0, k, h),
+            C.block(0, 0, m, h)); });
+        group.run([=] { view_BB_multiply_add(A, B.block(0, h, k, n - h),
+            C.block(0, h, m, n - h)); });
+        break;
+    }
+    case Split::K:
+    {
+        U h = k / 2;
+        view_BB_multiply_add(A.block(0, 0, m, h), B.block(0, 0, h, n), C);
+        view_BB_multiply_add(A.block(0, h, m, k - h), B.block(h, 0, k - h, n),
+            C);
+        break;
+    }
+    }
+
+    group.wait();
+}
+
 // Source for this simple block-based divide-and-conquer multiply:
 // https://en.wikipedia.org/wiki/Strassen_algorithm
 template<typename T>
 Matrix<T>* Matrix<T>::BB_multiply(const Matrix<T>* B) const
 {
-    U size = get_nRows();
-    assert(size == get_nCols());
-    assert(size == B->get_nRows());
-    assert(size == B->get_nCols());
+    return BB_multiply(B, Layout::RowMajor);
+}
 
-    assert(is_power_of_2(size));
+template<typename T>
+Matrix<T>* Matrix<T>::BB_multiply(const Matrix<T>* B, Layout layout) const
+{
+    try
+    {
+        if (nCols != B->get_nRows())
+            throw std::invalid_argument( "BB_multiply(): dimension mismatch" );
 
-    U s2 = size / 2;
+        Matrix<T>* C = new Matrix<T>(nRows, B->get_nCols());
+        C->set_to_zero();
 
-    auto A11B11 = multiply_blocks(B, s2);
-    auto A12B21 = multiply_blocks(B, s2, 0, s2, s2, 0);
-    auto C11 = A11B11->add(A12B21);
+        if (layout == Layout::Morton)
+            view_Morton_BB_multiply_add(view(), B->view(), C->view());
+        else
+            view_BB_multiply_add(view(), B->view(), C->view());
 
-    auto A11B12 = multiply_blocks(B, s2, 0, 0, 0, s2);
-    auto A12B22 = multiply_blocks(B, s2, 0, s2, s2, s2);
-    auto C12 = A11B12->add(A12B22);
+        return C;
+    }
+    catch(std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << "\n";
+        return nullptr;
+    }
+    catch(...)
+    {
+        std::cerr << "Error: Unknown problem\n";
+        return nullptr;
+    }
+}
+
+// ----------------------------------------------------
 
-    auto A21B11 = multiply_blocks(B, s2, s2, 0);
-    auto A22B21 = multiply_blocks(B, s2, s2, s2, s2, 0);
-    auto C21 = A21B11->add(A22B21);
+// Leaf size for SB_multiply().
+// Below about 256x256, gemm() is fast enough that Strassen's extra additions
+// (and their memory traffic) outweigh the multiplications they save.
+static U SB_leaf_size = 256;
 
-    auto A21B12 = multiply_blocks(B, s2, s2, 0, 0, s2);
-    auto A22B22 = multiply_blocks(B, s2, s2, s2, s2, s2);
-    auto C22 = A21B12->add(A22B22);
+U get_SB_leaf_size()
+{
+    return SB_leaf_size;
+}
 
-    return assemble(C11, C12, C21, C22);
+void set_SB_leaf_size(U n)
+{
+    assert(n >= 1);
+    SB_leaf_size = n;
+}
+
+// Parallel depth for SB_multiply().
+// Two levels give 49 concurrent products: enough to fill 32-64 cores.
+static U SB_parallel_depth = 2;
+
+U get_SB_parallel_depth()
+{
+    return SB_parallel_depth;
+}
+
+void set_SB_parallel_depth(U n)
+{
+    SB_parallel_depth = n;
 }
 
 // ----------------------------------------------------
 
+// Shape handling shared by SB_multiply() and SW_multiply().
+//
+// A Strassen step splits each of m, k, and n in two, which only pays off
+// when all three are large, and comparable.  So, for an m x k x n multiply:
+// * If min(m, k, n) <= get_SB_leaf_size(): multiply with gemm().
+// * Otherwise, if the largest dimension is at least twice the smallest, split
+//   the largest in half, as in view_BB_multiply_add(), and recurse on the two
+//   halves.  This brings the shape closer to a cube, at no extra arithmetic.
+// * Otherwise, take one Strassen step on the largest even-sized block of the
+//   operands, and fix up the odd row, column, or inner dimension left over
+//   (if any) with gemm().  This "dynamic peeling" handles any size without
+//   padding.
+//
+// Source for dynamic peeling:
+// S. Huss-Lederman, E. M. Jacobson, J. R. Johnson, A. Tsao, T. Turnbull,
+// "Implementation of Strassen's algorithm for matrix multiplication",
+// Supercomputing 1996.
+
+// One Strassen step: C = A * B, for even m, k, and n.
+// `depth` is the number of Strassen steps above this one.
+template<typename T>
+using StrassenStep = void (*)(MatrixView<T> A, MatrixView<T> B,
+    MatrixView<T> C, Workspace<T>& ws, U depth);
+
+// The workspace that a StrassenStep needs, for even m, k, and n.
+using StrassenStepSize = U (*)(U m, U k, U n, U depth);
+
+// Return true if an m x k x n multiply should be split in half, rather than
+// taking a Strassen step.
+static bool is_skewed(U m, U k, U n)
+{
+    return std::max({m, k, n}) >= 2 * std::min({m, k, n});
+}
+
+// C = A * B, using `step` for the Strassen steps.  (See above.)
+template<typename T>
+static void Strassen_multiply_recursive(MatrixView<T> A, MatrixView<T> B,
+    MatrixView<T> C, Workspace<T>& ws, U depth, StrassenStep<T> step)
+{
+    U m = A.nRows;
+    U k = A.nCols;
+    U n = B.nCols;
+
+    if (std::min({m, k, n}) <= get_SB_leaf_size())
+    {
+        view_set_to_zero(C);
+        view_multiply_add(A, B, C);
+        return;
+    }
+
+    if (is_skewed(m, k, n))
+    {
+        switch (get_largest_dimension(m, k, n))
+        {
+        case Split::M:
+        {
+            U h = m / 2;
+            Strassen_multiply_recursive(A.block(0, 0, h, k), B,
+                C.block(0, 0, h, n), ws, depth, step);
+            Strassen_multiply_recursive(A.block(h, 0, m - h, k), B,
+                C.block(h, 0, m - h, n), ws, depth, step);
+            break;
+        }
+        case Split::N:
+        {
+            U h = n / 2;
+            Strassen_multiply_recursive(A, B.block(0, 0, k, h),
+                C.block(0, 0, m, h), ws, depth, step);
+            Strassen_multiply_recursive(A, B.block(0, h, k, n - h),
+                C.block(0, h, m, n - h), ws, depth, step);
+            break;
+        }
+        case Split::K:
+        {
+            // The second half goes into a temporary, and is then added to C.
+            U h = k / 2;
+            Strassen_multiply_recursive(A.block(0, 0, m, h),
+                B.block(0, 0, h, n), C, ws, depth, step);
+
+            U mark = ws.get_used();
+            auto P = ws.allocate(m, n);
+            Strassen_multiply_recursive(A.block(0, h, m, k - h),
+                B.block(h, 0, k - h, n), P, ws, depth, step);
+            view_add(C, P, C);
+            ws.release(mark);
+            break;
+        }
+        }
+        return;
+    }
+
+    // The even-sized blocks, and the leftovers.
+    U me = m & ~U(1);
+    U ke = k & ~U(1);
+    U ne = n & ~U(1);
+
+    auto C_even = C.block(0, 0, me, ne);
+    step(A.block(0, 0, me, ke), B.block(0, 0, ke, ne), C_even, ws, depth);
+
+    // Odd k: add the product of A's last column and B's last row.
+    if (ke < k)
+        view_multiply_add(A.block(0, ke, me, 1), B.block(ke, 0, 1, ne),
+            C_even);
+
+    // Odd n: C's last column.
+    if (ne < n)
+    {
+        auto C_col = C.block(0, ne, m, 1);
+        view_set_to_zero(C_col);
+        view_multiply_add(A, B.block(0, ne, k, 1), C_col);
+    }
+
+    // Odd m: C's last row, except for the corner done above.
+    if (me < m)
+    {
+        auto C_row = C.block(me, 0, 1, ne);
+        view_set_to_zero(C_row);
+        view_multiply_add(A.block(me, 0, 1, k), B.block(0, 0, k, ne), C_row);
+    }
+}
+
+// Return the workspace that Strassen_multiply_recursive() needs.
+// This mirrors its allocations: the two halves of a split run one after the
+// other, and so share the workspace.
+template<typename T>
+static U get_Strassen_workspace_size(U m, U k, U n, U depth,
+    StrassenStepSize step_size)
+{
+    if (std::min({m, k, n}) <= get_SB_leaf_size())
+        return 0;
+
+    if (is_skewed(m, k, n))
+    {
+        auto size = [=](U m, U k, U n)
+        {
+            return get_Strassen_workspace_size<T>(m, k, n, depth, step_size);
+        };
+
+        switch (get_largest_dimension(m, k, n))
+        {
+        case Split::M:
+            return std::max(size(m / 2, k, n), size(m - m / 2, k, n));
+        case Split::N:
+            return std::max(size(m, k, n / 2), size(m, k, n - n / 2));
+        case Split::K:
+            return std::max(size(m, k / 2, n),
+                Workspace<T>::get_allocation_size(m, n)
+                    + size(m, k - k / 2, n));
+        }
+    }
+
+    return step_size(m & ~U(1), k & ~U(1), n & ~U(1), depth);
+}
+
+// ----------------------------------------------------
+
+// Return true if SB_step() spawns parallel tasks at `depth`.
+static bool SB_is_parallel(U depth)
+{
+    return (depth < get_SB_parallel_depth()) && (get_num_threads() > 1);
+}
+
+// Return the workspace that SB_step() needs.
+// This mirrors the allocations in SB_step():
+// * the seven products M1..M7
+// * serial: the operand sums X and Y of one product at a time, plus the
+//   workspace of one recursive call at a time
+// * parallel: X, Y, and the recursive call's workspace, for each of the
+//   seven products at once
+template<typename T>
+static U get_SB_step_workspace_size(U m, U k, U n, U depth)
+{
+    U m2 = m / 2;
+    U k2 = k / 2;
+    U n2 = n / 2;
+
+    U per_product = Workspace<T>::get_allocation_size(m2, k2)
+        + Workspace<T>::get_allocation_size(k2, n2)
+        + get_Strassen_workspace_size<T>(m2, k2, n2, depth + 1,
+            get_SB_step_workspace_size<T>);
+
+    return 7 * Workspace<T>::get_allocation_size(m2, n2)
+        + (SB_is_parallel(depth) ? 7 : 1) * per_product;
+}
+
+template<typename T>
+U get_SB_workspace_size(U m, U k, U n)
+{
+    return get_Strassen_workspace_size<T>(m, k, n, 0,
+        get_SB_step_workspace_size<T>);
+}
+
+template<typename T>
+U get_SB_workspace_size(U size)
+{
+    return get_SB_workspace_size<T>(size, size, size);
+}
+
+// C = A * B, for even m, k, and n.
+// `depth` is the number of Strassen steps above this one.
+//
 // Source for this Strassen-based multiply:
 // https://en.wikipedia.org/wiki/Strassen_algorithm
+//
+// The quadrants of A and B are used in place, and the combinations are
+// written straight into the quadrants of C, each in a single fused pass (see
+// expression.h).  The operand sums and the seven products are the only
+// temporaries, and they come from `ws`.
+//
+// Each product M1..M7 (operand sums included) is a task, and so, once all
+// seven are done, is each of the combinations C11..C22.  The products recurse
+// into tasks of their own, down to get_SB_parallel_depth() levels; below that,
+// each product runs to completion (and releases its operands) before the next
+// one starts.
+template<typename T>
+static void SB_step(MatrixView<T> A, MatrixView<T> B, MatrixView<T> C,
+    Workspace<T>& ws, U depth)
+{
+    U m2 = A.nRows / 2;
+    U k2 = A.nCols / 2;
+    U n2 = B.nCols / 2;
+
+    auto A11 = A.quadrant(0, 0), A12 = A.quadrant(0, 1);
+    auto A21 = A.quadrant(1, 0), A22 = A.quadrant(1, 1);
+    auto B11 = B.quadrant(0, 0), B12 = B.quadrant(0, 1);
+    auto B21 = B.quadrant(1, 0), B22 = B.quadrant(1, 1);
+    auto C11 = C.quadrant(0, 0), C12 = C.quadrant(0, 1);
+    auto C21 = C.quadrant(1, 0), C22 = C.quadrant(1, 1);
+
+    U mark = ws.get_used();
+
+    auto M1 = ws.allocate(m2, n2), M2 = ws.allocate(m2, n2);
+    auto M3 = ws.allocate(m2, n2), M4 = ws.allocate(m2, n2);
+    auto M5 = ws.allocate(m2, n2), M6 = ws.allocate(m2, n2);
+    auto M7 = ws.allocate(m2, n2);
+
+    bool parallel = SB_is_parallel(depth);
+    U task_ws_size = Workspace<T>::get_allocation_size(m2, k2)
+        + Workspace<T>::get_allocation_size(k2, n2)
+        + get_Strassen_workspace_size<T>(m2, k2, n2, depth + 1,
+            get_SB_step_workspace_size<T>);
+    TaskGroup group;
+
+    // Run `product`, which allocates its operand sums from the workspace it
+    // is given, and recurses.  When parallel, give it a chunk of its own.
+    // Generic, so that the serial path calls each lambda directly, without
+    // wrapping it in a std::function, which would allocate.
+    auto spawn_product = [&](auto product)
+    {
+        if (!parallel)
+        {
+            U product_mark = ws.get_used();
+            product(ws);
+            ws.release(product_mark);
+            return;
+        }
+
+        T* chunk = ws.allocate_raw(task_ws_size);
+        group.run([=]
+        {
+            Workspace<T> task_ws(chunk, task_ws_size);
+            product(task_ws);
+        });
+    };
+
+    auto spawn = [&](auto task)
+    {
+        if (parallel)
+            group.run(task);
+        else
+            task();
+    };
+
+    auto recurse = [depth](MatrixView<T> X, MatrixView<T> Y, MatrixView<T> M,
+        Workspace<T>& w)
+    {
+        PERF_SCOPE(PerfPhase::SB_products);
+        Strassen_multiply_recursive(X, Y, M, w, depth + 1, SB_step<T>);
+    };
+
+    spawn_product([=](Workspace<T>& w) {
+        auto X = w.allocate(m2, k2), Y = w.allocate(k2, n2);
+        {
+            PERF_SCOPE(PerfPhase::SB_sums);
+            view_add(A11, A22, X);
+            view_add(B11, B22, Y);
+        }
+        recurse(X, Y, M1, w); });       // (A11 + A22) * (B11 + B22)
+
+    spawn_product([=](Workspace<T>& w) {
+        auto X = w.allocate(m2, k2);
+        {
+            PERF_SCOPE(PerfPhase::SB_sums);
+            view_add(A21, A22, X);
+        }
+        recurse(X, B11, M2, w); });     // (A21 + A22) * B11
+
+    spawn_product([=](Workspace<T>& w) {
+        auto Y = w.allocate(k2, n2);
+        {
+            PERF_SCOPE(PerfPhase::SB_sums);
+            view_subtract(B12, B22, Y);
+        }
+        recurse(A11, Y, M3, w); });     // A11 * (B12 - B22)
+
+    spawn_product([=](Workspace<T>& w) {
+        auto Y = w.allocate(k2, n2);
+        {
+            PERF_SCOPE(PerfPhase::SB_sums);
+            view_subtract(B21, B11, Y);
+        }
+        recurse(A22, Y, M4, w); });     // A22 * (B21 - B11)
+
+    spawn_product([=](Workspace<T>& w) {
+        auto X = w.allocate(m2, k2);
+        {
+            PERF_SCOPE(PerfPhase::SB_sums);
+            view_add(A11, A12, X);
+        }
+        recurse(X, B22, M5, w); });     // (A11 + A12) * B22
+
+    spawn_product([=](Workspace<T>& w) {
+        auto X = w.allocate(m2, k2), Y = w.allocate(k2, n2);
+        {
+            PERF_SCOPE(PerfPhase::SB_sums);
+            view_subtract(A21, A11, X);
+            view_add(B11, B12, Y);
+        }
+        recurse(X, Y, M6, w); });       // (A21 - A11) * (B11 + B12)
+
+    spawn_product([=](Workspace<T>& w) {
+        auto X = w.allocate(m2, k2), Y = w.allocate(k2, n2);
+        {
+            PERF_SCOPE(PerfPhase::SB_sums);
+            view_subtract(A12, A22, X);
+            view_add(B21, B22, Y);
+        }
+        recurse(X, Y, M7, w); });       // (A12 - A22) * (B21 + B22)
+
+    group.wait();
+
+    spawn([&] { PERF_SCOPE(PerfPhase::SB_combine);
+        view_assign(C11, expr(M1) + expr(M4) - expr(M5) + expr(M7)); });
+    spawn([&] { PERF_SCOPE(PerfPhase::SB_combine);
+        view_add(M3, M5, C12); });
+    spawn([&] { PERF_SCOPE(PerfPhase::SB_combine);
+        view_add(M2, M4, C21); });
+    spawn([&] { PERF_SCOPE(PerfPhase::SB_combine);
+        view_assign(C22, expr(M1) - expr(M2) + expr(M3) + expr(M6)); });
+
+    group.wait();
+
+    ws.release(mark);
+}
+
+template<typename T>
+void view_SB_multiply(MatrixView<T> A, MatrixView<T> B, MatrixView<T> C,
+    Workspace<T>& ws)
+{
+    assert(A.nCols == B.nRows);
+    assert((A.nRows == C.nRows) && (B.nCols == C.nCols));
+
+    Strassen_multiply_recursive(A, B, C, ws, 0, SB_step<T>);
+}
+
+template<typename T>
+void view_SB_multiply(MatrixView<T> A, MatrixView<T> B, MatrixView<T> C)
+{
+    Workspace<T> ws(get_SB_workspace_size<T>(A.nRows, A.nCols, B.nCols));
+    view_SB_multiply(A, B, C, ws);
+}
+
 template<typename T>
 Matrix<T>* Matrix<T>::SB_multiply(const Matrix<T>* B) const
 {
-    U size = get_nRows();
-    assert(size == get_nCols());
-    assert(size == B->get_nRows());
-    assert(size == B->get_nCols());
+    try
+    {
+        if (nCols != B->get_nRows())
+            throw std::invalid_argument( "SB_multiply(): dimension mismatch" );
+
+        Matrix<T>* C = new Matrix<T>(nRows, B->get_nCols());
+
+        view_SB_multiply(view(), B->view(), C->view());
+
+        return C;
+    }
+    catch(std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << "\n";
+        return nullptr;
+    }
+    catch(...)
+    {
+        std::cerr << "Error: Unknown problem\n";
+        return nullptr;
+    }
+}
+
+// ----------------------------------------------------
+
+// Return the workspace that SW_step() needs: X, which holds both m/2 x k/2
+// operand sums and an m/2 x n/2 product, Y, and one recursive call at a time.
+template<typename T>
+static U get_SW_step_workspace_size(U m, U k, U n, U depth)
+{
+    U m2 = m / 2;
+    U k2 = k / 2;
+    U n2 = n / 2;
+
+    return std::max(Workspace<T>::get_allocation_size(m2, k2),
+                    Workspace<T>::get_allocation_size(m2, n2))
+        + Workspace<T>::get_allocation_size(k2, n2)
+        + get_Strassen_workspace_size<T>(m2, k2, n2, depth + 1,
+            get_SW_step_workspace_size<T>);
+}
+
+template<typename T>
+U get_SW_workspace_size(U m, U k, U n)
+{
+    return get_Strassen_workspace_size<T>(m, k, n, 0,
+        get_SW_step_workspace_size<T>);
+}
+
+template<typename T>
+U get_SW_workspace_size(U size)
+{
+    return get_SW_workspace_size<T>(size, size, size);
+}
+
+// C = A * B, for even m, k, and n.
+//
+// Source for the Strassen-Winograd variant, and for this schedule, which
+// needs only two temporaries (X and Y) per level:
+// B. Boyer, J.-G. Dumas, C. Pernet, W. Zhou, "Memory efficient scheduling of
+// Strassen-Winograd's matrix multiplication algorithm", ISSAC 2009, table 1.
+//
+// With
+//   S1 = A21 + A22     T1 = B12 - B11      P1 = A11 * B11    P5 = S1 * T1
+//   S2 = S1 - A11      T2 = B22 - T1       P2 = A12 * B21    P6 = S2 * T2
+//   S3 = A11 - A21     T3 = B22 - B12      P3 = S4 * B22     P7 = S3 * T3
+//   S4 = A12 - S2      T4 = T2 - B21       P4 = A22 * T4
+// and
+//   U2 = P1 + P6       U3 = U2 + P7        U4 = U2 + P5
+// the result is
+//   C11 = P1 + P2      C12 = U4 + P3
+//   C21 = U3 - P4      C22 = U3 + P5
+//
+// The quadrants of C hold intermediate products and sums until they are
+// overwritten with their final values.  The steps run one after another, so
+// parallelism comes only from the leaves.
+template<typename T>
+static void SW_step(MatrixView<T> A, MatrixView<T> B, MatrixView<T> C,
+    Workspace<T>& ws, U depth)
+{
+    U m2 = A.nRows / 2;
+    U k2 = A.nCols / 2;
+    U n2 = B.nCols / 2;
+
+    auto A11 = A.quadrant(0, 0), A12 = A.quadrant(0, 1);
+    auto A21 = A.quadrant(1, 0), A22 = A.quadrant(1, 1);
+    auto B11 = B.quadrant(0, 0), B12 = B.quadrant(0, 1);
+    auto B21 = B.quadrant(1, 0), B22 = B.quadrant(1, 1);
+    auto C11 = C.quadrant(0, 0), C12 = C.quadrant(0, 1);
+    auto C21 = C.quadrant(1, 0), C22 = C.quadrant(1, 1);
+
+    U mark = ws.get_used();
+
+    // X holds the S's (m/2 x k/2), and then P1 (m/2 x n/2).
+    T* x = ws.allocate_raw(std::max(Workspace<T>::get_allocation_size(m2, k2),
+                                    Workspace<T>::get_allocation_size(m2, n2)));
+    MatrixView<T> X = { x, m2, k2, get_padded_ld<T>(k2) };
+    MatrixView<T> P1 = { x, m2, n2, get_padded_ld<T>(n2) };
+    auto Y = ws.allocate(k2, n2);
+
+    auto recurse = [&](MatrixView<T> A, MatrixView<T> B, MatrixView<T> C)
+    {
+        Strassen_multiply_recursive(A, B, C, ws, depth + 1, SW_step<T>);
+    };
+
+    view_subtract(A11, A21, X);             // X   = S3
+    view_subtract(B22, B12, Y);             // Y   = T3
+    recurse(X, Y, C21);                     // C21 = P7 = S3 * T3
+
+    view_add(A21, A22, X);                  // X   = S1
+    view_subtract(B12, B11, Y);             // Y   = T1
+    recurse(X, Y, C22);                     // C22 = P5 = S1 * T1
+
+    view_subtract(X, A11, X);               // X   = S2 = S1 - A11
+    view_subtract(B22, Y, Y);               // Y   = T2 = B22 - T1
+    recurse(X, Y, C12);                     // C12 = P6 = S2 * T2
+
+    view_subtract(A12, X, X);               // X   = S4 = A12 - S2
+    recurse(X, B22, C11);                   // C11 = P3 = S4 * B22
+
+    recurse(A11, B11, P1);                  // X   = P1 = A11 * B11
+
+    view_add(P1, C12, C12);                 // C12 = U2 = P1 + P6
+    view_add(C12, C21, C21);                // C21 = U3 = U2 + P7
+    view_add(C12, C22, C12);                // C12 = U4 = U2 + P5
+    view_add(C21, C22, C22);                // C22 = U7 = U3 + P5  (final)
+    view_add(C12, C11, C12);                // C12 = U5 = U4 + P3  (final)
+
+    view_subtract(Y, B21, Y);               // Y   = T4 = T2 - B21
+    recurse(A22, Y, C11);                   // C11 = P4 = A22 * T4
+    view_subtract(C21, C11, C21);           // C21 = U6 = U3 - P4  (final)
+
+    recurse(A12, B21, C11);                 // C11 = P2 = A12 * B21
+    view_add(P1, C11, C11);                 // C11 = U1 = P1 + P2  (final)
+
+    ws.release(mark);
+}
+
+template<typename T>
+void view_SW_multiply(MatrixView<T> A, MatrixView<T> B, MatrixView<T> C,
+    Workspace<T>& ws)
+{
+    assert(A.nCols == B.nRows);
+    assert((A.nRows == C.nRows) && (B.nCols == C.nCols));
 
-    assert(is_power_of_2(size));
+    Strassen_multiply_recursive(A, B, C, ws, 0, SW_step<T>);
+}
 
-    U s2 = size / 2;
+template<typename T>
+void view_SW_multiply(MatrixView<T> A, MatrixView<T> B, MatrixView<T> C)
+{
+    Workspace<T> ws(get_SW_workspace_size<T>(A.nRows, A.nCols, B.nCols));
+    view_SW_multiply(A, B, C, ws);
+}
 
-    const auto A = this;
+template<typename T>
+Matrix<T>* Matrix<T>::SW_multiply(const Matrix<T>* B) const
+{
+    return SW_multiply(B, Layout::RowMajor);
+}
 
-    auto M1A = A->add_blocks(A, s2, 0, 0, s2, s2);        // A11 + A22
-    auto M1B = B->add_blocks(B, s2, 0, 0, s2, s2);        // B11 + B22
-    auto M1 = M1A->multiply_blocks(M1B, s2);
+template<typename T>
+Matrix<T>* Matrix<T>::SW_multiply(const Matrix<T>* B, Layout layout) const
+{
+    try
+    {
+        if (nCols != B->get_nRows())
+            throw std::invalid_argument( "SW_multiply(): dimension mismatch" );
 
-    auto M2A = A->add_blocks(A, s2, s2, 0, s2, s2);       // A21 + A22
-    auto M2 = M2A->multiply_blocks(B, s2);                // M2A * B11
+        Matrix<T>* C = new Matrix<T>(nRows, B->get_nCols());
 
-    auto M3B = B->subtract_blocks(B, s2, 0, s2, s2, s2);  // B12 - B22
-    auto M3 = A->multiply_blocks(M3B, s2);                // A11 * M3B
+        if (layout == Layout::Morton)
+            view_Morton_SW_multiply(view(), B->view(), C->view());
+        else
+            view_SW_multiply(view(), B->view(), C->view());
 
-    auto M4B = B->subtract_blocks(B, s2, s2, 0, 0, 0);    // B21 - B11
-    auto M4 = A->multiply_blocks(M4B, s2, s2, s2);        // A22 * M4B
+        return C;
+    }
+    catch(std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << "\n";
+        return nullptr;
+    }
+    catch(...)
+    {
+        std::cerr << "Error: Unknown problem\n";
+        return nullptr;
+    }
+}
 
-    auto M5A = A->add_blocks(A, s2, 0, 0, 0, s2);         // A11 + A12
-    auto M5 = M5A->multiply_blocks(B, s2, 0, 0, s2, s2);  // M5A * B22
+// ----------------------------------------------------
 
-    auto M6A = A->subtract_blocks(A, s2, s2, 0, 0, 0);    // A21 - A11
-    auto M6B = B->add_blocks(B, s2, 0, 0, 0, s2);         // B11 + B12
-    auto M6 = M6A->multiply_blocks(M6B, s2);
+template<typename T>
+Matrix<T>* Matrix<T>::BL_multiply(const Matrix<T>* B,
+    const std::vector<BilinearScheme>& schemes) const
+{
+    try
+    {
+        if (nCols != B->get_nRows())
+            throw std::invalid_argument( "BL_multiply(): dimension mismatch" );
+        if (schemes.empty())
+            throw std::invalid_argument( "BL_multiply(): no schemes" );
 
-    auto M7A = A->subtract_blocks(A, s2, 0, s2, s2, s2);  // A12 - A22
-    auto M7B = B->add_blocks(B, s2, s2, 0, s2, s2);       // B21 + B22
-    auto M7 = M7A->multiply_blocks(M7B, s2);
+        Matrix<T>* C = new Matrix<T>(nRows, B->get_nCols());
 
-    auto C11 = M1->add(M4)->subtract(M5)->add(M7);
-    auto C12 = M3->add(M5);
-    auto C21 = M2->add(M4);
-    auto C22 = M1->subtract(M2)->add(M3)->add(M6);
+        view_BL_multiply(view(), B->view(), C->view(), schemes);
 
-    return assemble(C11, C12, C21, C22);
+        return C;
+    }
+    catch(std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << "\n";
+        return nullptr;
+    }
+    catch(...)
+    {
+        std::cerr << "Error: Unknown problem\n";
+        return nullptr;
+    }
 }
 
 // ----------------------------------------------------
@@ -723,6 +1595,8 @@ template<typename T>
 Matrix<T>* assemble(Matrix<T>* m11, Matrix<T>* m12,
     Matrix<T>* m21, Matrix<T>* m22)
 {
+    PERF_SCOPE(PerfPhase::assemble);
+
     U size = m11->get_nRows();
 
     if (size != m11->get_nCols())
@@ -0,0 +1,675 @@
+#include "matrix_file.h"
+#include "allocation.h"
+#include "simd.h"
+#include "thread_pool.h"
+
+#include <cerrno>
+#include <cstdio>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define HAVE_POSIX_IO 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Explicit template instantiation.  (See matrix.cpp for details.)
+#define INSTANTIATE_MATRIX_FILE(T)                                          \
+    template bool save_matrix(const Matrix<T>* A, const string& path);      \
+    template bool view_save_matrix(MatrixView<T> A, const string& path);    \
+    template bool Morton_save_matrix(MortonView<T> A, const string& path);  \
+    template Matrix<T>* load_matrix(const string& path);                    \
+    template class MappedMatrix<T>;                                         \
+    template class MatrixFile<T>;
+
+INSTANTIATE_MATRIX_FILE(int)
+INSTANTIATE_MATRIX_FILE(double)
+
+// ----------------------------------------------------
+
+static const char MAGIC[8] = { 'M', 'A', 'T', 'R', 'I', 'X', 0, 0 };
+static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+static const uint32_t VERSION = 1;
+
+// The payload starts on a page, for any page size up to this.
+static const U PAYLOAD_ALIGNMENT = 4096;
+
+template<typename T> MatrixFileType get_file_type();
+template<> MatrixFileType get_file_type<int>()
+    { return MatrixFileType::Int32; }
+template<> MatrixFileType get_file_type<double>()
+    { return MatrixFileType::Float64; }
+
+static std::string get_error_text(const string& what, const string& path)
+{
+    return what + " " + path + ": " + strerror(errno);
+}
+
+// ----------------------------------------------------
+
+// A bijective mix of 64 bits (the finalizer of SplitMix64, less one round).
+static inline uint64_t mix(uint64_t x)
+{
+    x ^= x >> 31;
+    x *= 0xBF58476D1CE4E5B9;
+    x ^= x >> 29;
+    return x;
+}
+
+// Return the sum of mix(index * K + word) over the n 32-bit words at `bytes`
+// (or n zero words, if `bytes` is null), numbered from `first`.
+// Vectorized, once per instruction set.  (See simd.h.)
+SIMD_CLONES
+static uint64_t checksum_words(const char* bytes, U n, uint64_t first)
+{
+    const uint64_t K = 0x9E3779B97F4A7C15;
+    uint64_t sum = 0;
+
+    if (!bytes)
+    {
+        for (U w = 0; w < n; w++)
+            sum += mix((first + w) * K);
+        return sum;
+    }
+
+    for (U w = 0; w < n; w++)
+    {
+        uint32_t word;
+        memcpy(&word, bytes + w * sizeof(word), sizeof(word));
+        sum += mix((first + w) * K + word);
+    }
+
+    return sum;
+}
+
+// Below this many elements, checksum on the calling thread.
+static const U MIN_PARALLEL_ELEMENTS = 1 << 16;
+
+// Return the checksum of A as a payload: nRows rows of ld elements, of which
+// those past nCols are zero.
+template<typename T>
+static uint64_t get_checksum(MatrixView<T> A)
+{
+    static_assert(sizeof(T) % sizeof(uint32_t) == 0, "whole 32-bit words");
+    const U words = sizeof(T) / sizeof(uint32_t);
+
+    auto checksum_rows = [&](U begin, U end)
+    {
+        uint64_t sum = 0;
+        for (U i = begin; i < end; i++)
+        {
+            uint64_t first = i * A.ld * words;
+            sum += checksum_words((const char*) A.row(i), A.nCols * words,
+                first);
+            sum += checksum_words(nullptr, (A.ld - A.nCols) * words,
+                first + A.nCols * words);
+        }
+        return sum;
+    };
+
+    U m = A.nRows;
+
+    if ((m * A.ld < MIN_PARALLEL_ELEMENTS) || (get_num_threads() == 1))
+        return checksum_rows(0, m);
+
+    U num_tiles = std::min(m, 4 * get_num_threads());
+    std::vector<uint64_t> sums(num_tiles);
+    parallel_for(num_tiles, [&](U tile)
+    {
+        sums[tile] = checksum_rows(m * tile / num_tiles,
+            m * (tile + 1) / num_tiles);
+    });
+
+    uint64_t sum = 0;
+    for (uint64_t s : sums)
+        sum += s;
+    return sum;
+}
+
+// A Morton payload is contiguous: view it as rows of one tile's width.
+template<typename T>
+static MatrixView<T> get_payload_view(MortonView<T> A)
+{
+    return { A.data, A.get_num_elements() / A.tile_cols, A.tile_cols,
+        A.tile_cols };
+}
+
+// ----------------------------------------------------
+
+// Return a header for a payload of `rows`, in `layout`, with its checksum.
+template<typename T>
+static MatrixFileHeader make_header(MatrixView<T> rows, Layout layout)
+{
+    MatrixFileHeader header;
+    memset(&header, 0, sizeof(header));
+
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.byte_order = BYTE_ORDER_MARK;
+    header.version = VERSION;
+    header.type = (uint32_t) get_file_type<T>();
+    header.layout = (uint32_t) layout;
+    header.element_size = sizeof(T);
+    header.nRows = rows.nRows;
+    header.nCols = rows.nCols;
+    header.ld = rows.ld;
+    header.alignment = PAYLOAD_ALIGNMENT;
+    header.payload_offset = PAYLOAD_ALIGNMENT;
+    header.payload_bytes = rows.nRows * rows.ld * sizeof(T);
+    header.checksum = get_checksum(rows);
+
+    return header;
+}
+
+// Write `header`, and then the rows of `rows`, each padded with zeros to
+// `rows.ld` elements.
+template<typename T>
+static void write_file(const string& path, const MatrixFileHeader& header,
+    MatrixView<T> rows)
+{
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file)
+        throw std::runtime_error(get_error_text("cannot create", path));
+
+    std::vector<char> zeros(std::max(header.payload_offset,
+        (rows.ld - rows.nCols) * sizeof(T)), 0);
+
+    bool ok = (fwrite(&header, sizeof(header), 1, file) == 1)
+        && (fwrite(zeros.data(), header.payload_offset - sizeof(header), 1,
+            file) == 1);
+
+    U padding = (rows.ld - rows.nCols) * sizeof(T);
+    for (U i = 0; ok && (i < rows.nRows); i++)
+    {
+        ok = (fwrite(rows.row(i), sizeof(T), rows.nCols, file) == rows.nCols)
+            && (!padding || (fwrite(zeros.data(), padding, 1, file) == 1));
+    }
+
+    if (fclose(file) || !ok)
+        throw std::runtime_error(get_error_text("cannot write", path));
+}
+
+template<typename T>
+bool save_matrix(const Matrix<T>* A, const string& path)
+{
+    return view_save_matrix(A->view(), path);
+}
+
+template<typename T>
+bool view_save_matrix(MatrixView<T> A, const string& path)
+{
+    try
+    {
+        write_file(path, make_header(A, Layout::RowMajor), A);
+        return true;
+    }
+    catch(std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << "\n";
+        return false;
+    }
+    catch(...)
+    {
+        std::cerr << "Error: Unknown problem\n";
+        return false;
+    }
+}
+
+template<typename T>
+bool Morton_save_matrix(MortonView<T> A, const string& path)
+{
+    try
+    {
+        MatrixView<T> rows = get_payload_view(A);
+        MatrixFileHeader header = make_header(rows, Layout::Morton);
+
+        // The dimensions of the matrix, not of the payload's rows.
+        header.nRows = A.get_nRows();
+        header.nCols = A.get_nCols();
+        header.levels = A.levels;
+        header.tile_rows = A.tile_rows;
+
+        write_file(path, header, rows);
+        return true;
+    }
+    catch(std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << "\n";
+        return false;
+    }
+    catch(...)
+    {
+        std::cerr << "Error: Unknown problem\n";
+        return false;
+    }
+}
+
+// ----------------------------------------------------
+
+// Return a * b, or throw if it overflows.
+static U multiply_sizes(U a, U b)
+{
+    U product;
+    if (__builtin_mul_overflow(a, b, &product))
+        throw std::runtime_error("matrix file: sizes overflow");
+    return product;
+}
+
+// Throw unless `header` describes a valid file of T, of `file_size` bytes.
+template<typename T>
+static void check_header(const MatrixFileHeader& header, U file_size)
+{
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)))
+        throw std::runtime_error("matrix file: not a matrix file");
+    if (header.byte_order != BYTE_ORDER_MARK)
+        throw std::runtime_error("matrix file: wrong byte order");
+    if (header.version != VERSION)
+        throw std::runtime_error("matrix file: unknown version");
+    if ((header.type != (uint32_t) get_file_type<T>())
+            || (header.element_size != sizeof(T)))
+        throw std::runtime_error("matrix file: wrong element type");
+    if (!header.nRows || !header.nCols)
+        throw std::runtime_error("matrix file: empty matrix");
+
+    U payload_elements;
+    if (header.layout == (uint32_t) Layout::RowMajor)
+    {
+        if (header.ld < header.nCols)
+            throw std::runtime_error("matrix file: rows overlap");
+        payload_elements = multiply_sizes(header.nRows, header.ld);
+    }
+    else if (header.layout == (uint32_t) Layout::Morton)
+    {
+        if ((header.levels >= 32) || !header.tile_rows
+                || (header.nRows != (header.tile_rows << header.levels))
+                || (header.nCols != (header.ld << header.levels)))
+            throw std::runtime_error("matrix file: bad Morton grid");
+        payload_elements = multiply_sizes(header.nRows, header.nCols);
+    }
+    else
+        throw std::runtime_error("matrix file: unknown layout");
+
+    U alignment = header.alignment;
+    if ((alignment < 64) || (alignment & (alignment - 1))
+            || (header.payload_offset % alignment)
+            || (header.payload_offset < sizeof(header)))
+        throw std::runtime_error("matrix file: misaligned payload");
+
+    if ((header.payload_bytes != multiply_sizes(payload_elements, sizeof(T)))
+            || (header.payload_offset > file_size)
+            || (header.payload_bytes > file_size - header.payload_offset))
+        throw std::runtime_error("matrix file: truncated");
+}
+
+// Unmap, or free, the `size` bytes of a file at `base`.
+static void release(void* base, U size, bool mapped)
+{
+#if HAVE_POSIX_IO
+    if (mapped)
+    {
+        munmap(base, size);
+        return;
+    }
+#endif
+    free_aligned((double*) base, (size + 7) / 8);
+}
+
+template<typename T>
+MappedMatrix<T>::MappedMatrix(void* base, U size, bool mapped,
+    const MatrixFileHeader& header)
+    : base(base), size(size), mapped(mapped), header(header)
+{
+}
+
+template<typename T>
+MappedMatrix<T>* MappedMatrix<T>::open(const string& path)
+{
+    void* base = nullptr;
+    U size = 0;
+    bool mapped = false;
+
+    try
+    {
+#if HAVE_POSIX_IO
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error(get_error_text("cannot open", path));
+
+        struct stat st;
+        if (fstat(fd, &st))
+        {
+            ::close(fd);
+            throw std::runtime_error(get_error_text("cannot stat", path));
+        }
+        size = st.st_size;
+
+        if (size >= sizeof(MatrixFileHeader))
+        {
+            base = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            if (base == MAP_FAILED)
+            {
+                base = nullptr;
+                ::close(fd);
+                throw std::runtime_error(get_error_text("cannot map", path));
+            }
+            mapped = true;
+        }
+
+        // The mapping holds its own reference to the file.
+        ::close(fd);
+#else
+        FILE* file = fopen(path.c_str(), "rb");
+        if (!file)
+            throw std::runtime_error(get_error_text("cannot open", path));
+
+        fseek(file, 0, SEEK_END);
+        size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+
+        if (size >= sizeof(MatrixFileHeader))
+        {
+            base = allocate_aligned<double>((size + 7) / 8);
+            if (fread(base, size, 1, file) != 1)
+            {
+                fclose(file);
+                free_aligned((double*) base, (size + 7) / 8);
+                base = nullptr;
+                throw std::runtime_error(get_error_text("cannot read", path));
+            }
+        }
+        fclose(file);
+#endif
+
+        if (!base)
+            throw std::runtime_error("matrix file: truncated");
+
+        MatrixFileHeader header;
+        memcpy(&header, base, sizeof(header));
+        check_header<T>(header, size);
+
+        return new MappedMatrix<T>(base, size, mapped, header);
+    }
+    catch(std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << "\n";
+    }
+    catch(...)
+    {
+        std::cerr << "Error: Unknown problem\n";
+    }
+
+    // The header was bad.
+    if (base)
+        release(base, size, mapped);
+    return nullptr;
+}
+
+template<typename T>
+MappedMatrix<T>::~MappedMatrix()
+{
+    release(base, size, mapped);
+}
+
+template<typename T>
+MatrixView<T> MappedMatrix<T>::view() const
+{
+    assert(get_layout() == Layout::RowMajor);
+    return { get_payload(), header.nRows, header.nCols, header.ld };
+}
+
+template<typename T>
+MortonView<T> MappedMatrix<T>::Morton_view() const
+{
+    assert(get_layout() == Layout::Morton);
+    return { get_payload(), header.levels, header.tile_rows, header.ld };
+}
+
+template<typename T>
+bool MappedMatrix<T>::verify_checksum() const
+{
+    MatrixView<T> rows = (get_layout() == Layout::RowMajor) ? view()
+        : get_payload_view(Morton_view());
+    return get_checksum(rows) == header.checksum;
+}
+
+// ----------------------------------------------------
+
+template<typename T>
+Matrix<T>* load_matrix(const string& path)
+{
+    MappedMatrix<T>* file = MappedMatrix<T>::open(path);
+    if (!file)
+        return nullptr;
+
+    Matrix<T>* C = nullptr;
+
+    try
+    {
+        if (file->get_layout() != Layout::RowMajor)
+            throw std::runtime_error("load_matrix(): not a row-major file");
+        if (!file->verify_checksum())
+            throw std::runtime_error("load_matrix(): checksum mismatch");
+
+        MatrixView<T> A = file->view();
+        C = new Matrix<T>(A.nRows, A.nCols);
+        view_copy(A, C->view());
+    }
+    catch(std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << "\n";
+    }
+    catch(...)
+    {
+        std::cerr << "Error: Unknown problem\n";
+    }
+
+    delete file;
+    return C;
+}
+
+// ----------------------------------------------------
+
+#if HAVE_POSIX_IO
+
+// pread() and pwrite() all of `bytes`, resuming after short transfers.
+static void read_all(int fd, void* buffer, U bytes, U offset)
+{
+    char* p = (char*) buffer;
+    while (bytes)
+    {
+        ssize_t done = pread(fd, p, bytes, offset);
+        if (done <= 0)
+            throw std::runtime_error(done ? get_error_text("cannot read",
+                "matrix file") : "matrix file: truncated");
+        p += done;
+        bytes -= done;
+        offset += done;
+    }
+}
+
+static void write_all(int fd, const void* buffer, U bytes, U offset)
+{
+    const char* p = (const char*) buffer;
+    while (bytes)
+    {
+        ssize_t done = pwrite(fd, p, bytes, offset);
+        if (done <= 0)
+            throw std::runtime_error(get_error_text("cannot write",
+                "matrix file"));
+        p += done;
+        bytes -= done;
+        offset += done;
+    }
+}
+
+#endif
+
+template<typename T>
+MatrixFile<T>::MatrixFile(int fd, const MatrixFileHeader& header)
+    : fd(fd), header(header), checksum(0)
+{
+}
+
+template<typename T>
+MatrixFile<T>* MatrixFile<T>::open(const string& path)
+{
+    try
+    {
+#if HAVE_POSIX_IO
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error(get_error_text("cannot open", path));
+
+        // Owns fd from here on, so an exception closes it.
+        MatrixFile<T>* file = new MatrixFile<T>(fd, MatrixFileHeader());
+
+        try
+        {
+            struct stat st;
+            if (fstat(fd, &st))
+                throw std::runtime_error(get_error_text("cannot stat", path));
+            if ((U) st.st_size < sizeof(MatrixFileHeader))
+                throw std::runtime_error("matrix file: truncated");
+
+            read_all(fd, &file->header, sizeof(MatrixFileHeader), 0);
+            check_header<T>(file->header, st.st_size);
+
+            if (file->header.layout != (uint32_t) Layout::RowMajor)
+                throw std::runtime_error("matrix file: not row-major");
+        }
+        catch(...)
+        {
+            delete file;
+            throw;
+        }
+
+        return file;
+#else
+        throw std::runtime_error("matrix file: block I/O needs POSIX");
+#endif
+    }
+    catch(std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << "\n";
+        return nullptr;
+    }
+    catch(...)
+    {
+        std::cerr << "Error: Unknown problem\n";
+        return nullptr;
+    }
+}
+
+template<typename T>
+MatrixFile<T>* MatrixFile<T>::create(const string& path, U nr, U nc)
+{
+    try
+    {
+#if HAVE_POSIX_IO
+        if (!nr || !nc)
+            throw std::invalid_argument("MatrixFile<T>::create(): empty");
+
+        // The header of the finished file, but for its checksum.
+        U ld = get_padded_ld<T>(nc);
+        MatrixFileHeader header = make_header(MatrixView<T>{ nullptr, 0, 0,
+            ld }, Layout::RowMajor);
+        header.nRows = nr;
+        header.nCols = nc;
+        header.payload_bytes = multiply_sizes(multiply_sizes(nr, ld),
+            sizeof(T));
+
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            throw std::runtime_error(get_error_text("cannot create", path));
+
+        // All zeros (and, on most file systems, no disk space) until written.
+        if (ftruncate(fd, header.payload_offset + header.payload_bytes))
+        {
+            ::close(fd);
+            throw std::runtime_error(get_error_text("cannot extend", path));
+        }
+
+        return new MatrixFile<T>(fd, header);
+#else
+        (void) nr;
+        (void) nc;
+        throw std::runtime_error("matrix file: block I/O needs POSIX");
+#endif
+    }
+    catch(std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << "\n";
+        return nullptr;
+    }
+    catch(...)
+    {
+        std::cerr << "Error: Unknown problem\n";
+        return nullptr;
+    }
+}
+
+template<typename T>
+MatrixFile<T>::~MatrixFile()
+{
+#if HAVE_POSIX_IO
+    ::close(fd);
+#endif
+}
+
+template<typename T>
+void MatrixFile<T>::read_block(U init_row, U init_col, MatrixView<T> C) const
+{
+    assert((init_row + C.nRows <= header.nRows)
+        && (init_col + C.nCols <= header.nCols));
+
+#if HAVE_POSIX_IO
+    // Whole rows, back to back in both: one read.
+    if ((C.nCols == header.nCols) && (C.ld == header.ld))
+    {
+        read_all(fd, C.data, C.nRows * C.ld * sizeof(T),
+            get_offset(init_row, 0));
+        return;
+    }
+
+    for (U i = 0; i < C.nRows; i++)
+        read_all(fd, C.row(i), C.nCols * sizeof(T),
+            get_offset(init_row + i, init_col));
+#endif
+}
+
+template<typename T>
+void MatrixFile<T>::write_block(MatrixView<T> A, U init_row, U init_col)
+{
+    assert((init_row + A.nRows <= header.nRows)
+        && (init_col + A.nCols <= header.nCols));
+
+    const U words = sizeof(T) / sizeof(uint32_t);
+
+    for (U i = 0; i < A.nRows; i++)
+    {
+#if HAVE_POSIX_IO
+        write_all(fd, A.row(i), A.nCols * sizeof(T),
+            get_offset(init_row + i, init_col));
+#endif
+        checksum += checksum_words((const char*) A.row(i), A.nCols * words,
+            ((init_row + i) * header.ld + init_col) * words);
+    }
+}
+
+template<typename T>
+void MatrixFile<T>::finish()
+{
+    const U words = sizeof(T) / sizeof(uint32_t);
+
+    // The padding, which is zero.
+    uint64_t sum = checksum;
+    for (U i = 0; i < header.nRows; i++)
+        sum += checksum_words(nullptr, (header.ld - header.nCols) * words,
+            (i * header.ld + header.nCols) * words);
+
+    header.checksum = sum;
+
+#if HAVE_POSIX_IO
+    write_all(fd, &header, sizeof(header), 0);
+#endif
+}
@@ -0,0 +1,195 @@
+#include "matrix.h"
+#include "gemm.h"
+#include "simd.h"
+
+// Explicit template instantiation.  (See matrix.cpp for details.)
+#define INSTANTIATE_VIEW_KERNELS(T)                                         \
+    template void view_copy(MatrixView<T> A, MatrixView<T> C);              \
+    template void view_set_to_zero(MatrixView<T> C);                        \
+    template void view_add(MatrixView<T> A, MatrixView<T> B,                \
+        MatrixView<T> C);                                                   \
+    template void view_subtract(MatrixView<T> A, MatrixView<T> B,           \
+        MatrixView<T> C);                                                   \
+    template void view_negate(MatrixView<T> A, MatrixView<T> C);            \
+    template void view_linear_combination(U num_terms,                      \
+        const T* coefficients, const MatrixView<T>* X, MatrixView<T> C);    \
+    template void view_multiply_add(MatrixView<T> A, MatrixView<T> B,       \
+        MatrixView<T> C);
+
+INSTANTIATE_VIEW_KERNELS(int)
+INSTANTIATE_VIEW_KERNELS(double)
+
+// ----------------------------------------------------
+
+template<typename T>
+static bool dimensions_match(MatrixView<T> A, MatrixView<T> B)
+{
+    return (A.nRows == B.nRows) && (A.nCols == B.nCols);
+}
+
+// ----------------------------------------------------
+
+template<typename T>
+void view_copy(MatrixView<T> A, MatrixView<T> C)
+{
+    assert(dimensions_match(A, C));
+
+    if (A.is_contiguous() && C.is_contiguous())
+    {
+        memcpy(C.data, A.data, A.nRows * A.nCols * sizeof(T));
+        return;
+    }
+
+    for (U i = 0; i < A.nRows; i++)
+        memcpy(C.row(i), A.row(i), A.nCols * sizeof(T));
+}
+
+template<typename T>
+void view_set_to_zero(MatrixView<T> C)
+{
+    if (C.is_contiguous())
+    {
+        memset(C.data, 0, C.nRows * C.nCols * sizeof(T));
+        return;
+    }
+
+    for (U i = 0; i < C.nRows; i++)
+        memset(C.row(i), 0, C.nCols * sizeof(T));
+}
+
+// ----------------------------------------------------
+
+// The elementwise kernels make one vectorized call per row, or a single call
+// if all the views are contiguous.
+
+template<typename T>
+void view_add(MatrixView<T> A, MatrixView<T> B, MatrixView<T> C)
+{
+    assert(dimensions_match(A, B) && dimensions_match(A, C));
+
+    if (A.is_contiguous() && B.is_contiguous() && C.is_contiguous())
+    {
+        vector_add(A.nRows * A.nCols, A.data, B.data, C.data);
+        return;
+    }
+
+    for (U i = 0; i < A.nRows; i++)
+        vector_add(A.nCols, A.row(i), B.row(i), C.row(i));
+}
+
+template<typename T>
+void view_subtract(MatrixView<T> A, MatrixView<T> B, MatrixView<T> C)
+{
+    assert(dimensions_match(A, B) && dimensions_match(A, C));
+
+    if (A.is_contiguous() && B.is_contiguous() && C.is_contiguous())
+    {
+        vector_sub(A.nRows * A.nCols, A.data, B.data, C.data);
+        return;
+    }
+
+    for (U i = 0; i < A.nRows; i++)
+        vector_sub(A.nCols, A.row(i), B.row(i), C.row(i));
+}
+
+template<typename T>
+void view_negate(MatrixView<T> A, MatrixView<T> C)
+{
+    assert(dimensions_match(A, C));
+
+    if (A.is_contiguous() && C.is_contiguous())
+    {
+        vector_negate(A.nRows * A.nCols, A.data, C.data);
+        return;
+    }
+
+    for (U i = 0; i < A.nRows; i++)
+        vector_negate(A.nCols, A.row(i), C.row(i));
+}
+
+// ----------------------------------------------------
+
+// Each row of C is built a chunk at a time, so the chunk stays in L1 while
+// the terms are added into it, and C is written to memory once.
+// The terms that are C itself are gathered into one coefficient, which
+// scales C first, so that C is read before it is overwritten; otherwise, the
+// first term sets C.
+template<typename T>
+void view_linear_combination(U num_terms, const T* coefficients,
+    const MatrixView<T>* X, MatrixView<T> C)
+{
+    const U CHUNK = 512;
+
+    T self = 0;
+    bool has_self = false;
+    U first = num_terms;
+
+    for (U t = 0; t < num_terms; t++)
+    {
+        assert(dimensions_match(X[t], C));
+
+        if (X[t].data == C.data)
+        {
+            assert(X[t].ld == C.ld);
+            self += coefficients[t];
+            has_self = true;
+        }
+        else if (first == num_terms)
+            first = t;
+    }
+
+    if (!has_self && (first == num_terms))
+    {
+        view_set_to_zero(C);
+        return;
+    }
+
+    // The term that sets C, if C is not itself a term.
+    U init = has_self ? num_terms : first;
+
+    for (U i = 0; i < C.nRows; i++)
+    {
+        for (U j0 = 0; j0 < C.nCols; j0 += CHUNK)
+        {
+            U len = std::min(CHUNK, C.nCols - j0);
+            T* c = C.row(i) + j0;
+
+            if (has_self)
+            {
+                for (U j = 0; j < len; j++)
+                    c[j] *= self;
+            }
+            else
+            {
+                const T* x0 = X[init].row(i) + j0;
+                T a0 = coefficients[init];
+
+                for (U j = 0; j < len; j++)
+                    c[j] = a0 * x0[j];
+            }
+
+            for (U t = first; t < num_terms; t++)
+            {
+                if ((t == init) || (X[t].data == C.data))
+                    continue;
+
+                const T* xt = X[t].row(i) + j0;
+                T at = coefficients[t];
+
+                for (U j = 0; j < len; j++)
+                    c[j] += at * xt[j];
+            }
+        }
+    }
+}
+
+// ----------------------------------------------------
+
+template<typename T>
+void view_multiply_add(MatrixView<T> A, MatrixView<T> B, MatrixView<T> C)
+{
+    assert(A.nCols == B.nRows);
+    assert((A.nRows == C.nRows) && (B.nCols == C.nCols));
+
+    gemm(C.nRows, C.nCols, A.nCols, A.data, A.ld, B.data, B.ld, C.data, C.ld);
+}
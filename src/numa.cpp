@@ -0,0 +1,236 @@
+#include "numa.h"
+#include "thread_pool.h"
+
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+// Explicit template instantiation.  (See matrix.cpp for details.)
+template void view_first_touch(MatrixView<int> C);
+template void view_first_touch(MatrixView<double> C);
+
+// ----------------------------------------------------
+
+// Parse a CPU list such as "0-3,8-11".
+static std::vector<int> parse_cpu_list(const string& list)
+{
+    std::vector<int> cpus;
+    std::istringstream stream(list);
+    string range;
+
+    while (std::getline(stream, range, ','))
+    {
+        if (range.empty() || !isdigit(range[0]))
+            continue;
+
+        auto dash = range.find('-');
+        int first = atoi(range.c_str());
+        int last = (dash == string::npos) ? first
+            : atoi(range.c_str() + dash + 1);
+
+        for (int cpu = first; cpu <= last; cpu++)
+            cpus.push_back(cpu);
+    }
+
+    return cpus;
+}
+
+#ifdef __linux__
+// The CPUs this process could run on when it started (before any pinning).
+static const cpu_set_t& get_initial_cpus()
+{
+    static cpu_set_t cpus = [] {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set))
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+                CPU_SET(cpu, &set);
+        return set;
+    }();
+    return cpus;
+}
+#endif
+
+static bool is_usable_cpu(int cpu)
+{
+#ifdef __linux__
+    return (cpu < CPU_SETSIZE) && CPU_ISSET(cpu, &get_initial_cpus());
+#else
+    return cpu < (int) std::thread::hardware_concurrency();
+#endif
+}
+
+// The usable CPUs of each node, with empty nodes left out.
+static const std::vector<std::vector<int>>& get_topology()
+{
+    static std::vector<std::vector<int>> nodes = [] {
+        std::vector<std::vector<int>> nodes;
+
+        for (U node = 0; ; node++)
+        {
+            std::ifstream file("/sys/devices/system/node/node"
+                + to_string(node) + "/cpulist");
+            if (!file)
+                break;
+
+            string list;
+            std::getline(file, list);
+
+            std::vector<int> cpus;
+            for (int cpu : parse_cpu_list(list))
+                if (is_usable_cpu(cpu))
+                    cpus.push_back(cpu);
+
+            if (!cpus.empty())
+                nodes.push_back(cpus);
+        }
+
+        if (nodes.empty())
+        {
+            std::vector<int> cpus;
+            for (int cpu = 0; cpu < 1024; cpu++)
+                if (is_usable_cpu(cpu))
+                    cpus.push_back(cpu);
+            if (cpus.empty())
+                cpus.push_back(0);
+            nodes.push_back(cpus);
+        }
+
+        return nodes;
+    }();
+
+    return nodes;
+}
+
+U get_num_numa_nodes()
+{
+    return get_topology().size();
+}
+
+const std::vector<int>& get_numa_node_cpus(U node)
+{
+    assert(node < get_num_numa_nodes());
+    return get_topology()[node];
+}
+
+// ----------------------------------------------------
+
+const char* get_affinity_name(Affinity affinity)
+{
+    switch (affinity)
+    {
+    case Affinity::None:    return "none";
+    case Affinity::Compact: return "compact";
+    case Affinity::Scatter: return "scatter";
+    }
+
+    return "unknown";
+}
+
+static Affinity thread_affinity = Affinity::None;
+
+Affinity get_thread_affinity()
+{
+    return thread_affinity;
+}
+
+void set_thread_affinity(Affinity affinity)
+{
+    thread_affinity = affinity;
+
+    // Restart the pool, which pins (or unpins) its workers, and pins the
+    // caller.
+    set_num_threads(get_num_threads());
+
+    if (affinity == Affinity::None)
+        pin_this_thread(-1);
+}
+
+int get_thread_cpu(U slot)
+{
+    const auto& nodes = get_topology();
+
+    switch (thread_affinity)
+    {
+    case Affinity::None:
+        return -1;
+
+    case Affinity::Compact:
+    {
+        U num_cpus = 0;
+        for (const auto& cpus : nodes)
+            num_cpus += cpus.size();
+
+        slot %= num_cpus;
+        for (const auto& cpus : nodes)
+        {
+            if (slot < cpus.size())
+                return cpus[slot];
+            slot -= cpus.size();
+        }
+        break;
+    }
+
+    case Affinity::Scatter:
+    {
+        const auto& cpus = nodes[slot % nodes.size()];
+        return cpus[(slot / nodes.size()) % cpus.size()];
+    }
+    }
+
+    return -1;
+}
+
+void pin_this_thread(int cpu)
+{
+#ifdef __linux__
+    cpu_set_t set;
+
+    if (cpu < 0)
+        set = get_initial_cpus();
+    else
+    {
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+    }
+
+    // Pinning is an optimization: if it fails, carry on unpinned.
+    if (sched_setaffinity(0, sizeof(set), &set))
+        DPRINTF(1)("pin_this_thread(%d) failed\n", cpu);
+#else
+    (void) cpu;
+#endif
+}
+
+// ----------------------------------------------------
+
+std::pair<U, U> get_thread_rows(U nr, U slot, U num_slots)
+{
+    assert(slot < num_slots);
+    return { nr * slot / num_slots, nr * (slot + 1) / num_slots };
+}
+
+// Below this size, a buffer spans too few pages to be worth splitting.
+static const U FIRST_TOUCH_MIN_BYTES = 2 << 20;
+
+bool is_placed_by_first_touch(U bytes)
+{
+    return (thread_affinity != Affinity::None)
+        && (bytes >= FIRST_TOUCH_MIN_BYTES);
+}
+
+template<typename T>
+void view_first_touch(MatrixView<T> C)
+{
+    parallel_for_each_thread([&](U slot, U num_slots)
+    {
+        auto rows = get_thread_rows(C.nRows, slot, num_slots);
+        view_set_to_zero(C.block(rows.first, 0, rows.second - rows.first,
+            C.nCols));
+    });
+}
@@ -0,0 +1,244 @@
+#include "out_of_core.h"
+#include "matrix_file.h"
+#include "workspace.h"
+
+#include <chrono>
+#include <future>
+#include <memory>
+
+// Explicit template instantiation.  (See matrix.cpp for details.)
+#define INSTANTIATE_OUT_OF_CORE(T)                                          \
+    template bool out_of_core_multiply<T>(const string& path_A,             \
+        const string& path_B, const string& path_C, U memory_budget,        \
+        OutOfCoreStats* stats);                                             \
+    template bool get_out_of_core_tiles<T>(U m, U k, U n,                   \
+        U memory_budget, U& tm, U& tk, U& tn);                              \
+    template U get_out_of_core_memory<T>(U tm, U tk, U tn);
+
+INSTANTIATE_OUT_OF_CORE(int)
+INSTANTIATE_OUT_OF_CORE(double)
+
+// ----------------------------------------------------
+
+// Tiles are a multiple of this on a side, where the budget allows.
+static const U TILE_MULTIPLE = 64;
+
+template<typename T>
+U get_out_of_core_memory(U tm, U tk, U tn)
+{
+    U elements = 2 * (Workspace<T>::get_allocation_size(tm, tk)
+        + Workspace<T>::get_allocation_size(tk, tn)
+        + Workspace<T>::get_allocation_size(tm, tn));
+    return elements * sizeof(T);
+}
+
+template<typename T>
+bool get_out_of_core_tiles(U m, U k, U n, U memory_budget, U& tm, U& tk,
+    U& tn)
+{
+    auto fits = [&](U t)
+    {
+        tm = std::min(t, m);
+        tk = std::min(t, k);
+        tn = std::min(t, n);
+        return get_out_of_core_memory<T>(tm, tk, tn) <= memory_budget;
+    };
+
+    // Cut d into as few tiles of at most t as possible, and then even them
+    // out, so that the last is not a sliver: e.g. 4096 into 2 x 2048, not
+    // 2944 + 1152.
+    auto balance = [](U d, U t)
+    {
+        U num_tiles = (d + t - 1) / t;
+        U even = (d + num_tiles - 1) / num_tiles;
+        U rounded = (even + TILE_MULTIPLE - 1) / TILE_MULTIPLE * TILE_MULTIPLE;
+        return std::min({ d, t, rounded });
+    };
+
+    // Whole multiples first, from the largest that could matter.
+    U largest = std::max({ m, k, n });
+    U t = (largest + TILE_MULTIPLE - 1) / TILE_MULTIPLE * TILE_MULTIPLE;
+    for (; t >= TILE_MULTIPLE; t -= TILE_MULTIPLE)
+    {
+        if (fits(t))
+        {
+            tm = balance(m, t);
+            tk = balance(k, t);
+            tn = balance(n, t);
+            return true;
+        }
+    }
+
+    for (t = TILE_MULTIPLE - 1; t >= 1; t--)
+    {
+        if (fits(t))
+            return true;
+    }
+
+    return false;
+}
+
+// ----------------------------------------------------
+
+using Clock = std::chrono::steady_clock;
+
+static double get_seconds_since(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+template<typename T>
+bool out_of_core_multiply(const string& path_A, const string& path_B,
+    const string& path_C, U memory_budget, OutOfCoreStats* stats)
+{
+    Clock::time_point start = Clock::now();
+
+    std::unique_ptr<MatrixFile<T>> A(MatrixFile<T>::open(path_A));
+    std::unique_ptr<MatrixFile<T>> B(MatrixFile<T>::open(path_B));
+    if (!A || !B)
+        return false;
+
+    try
+    {
+        U m = A->get_nRows();
+        U k = A->get_nCols();
+        U n = B->get_nCols();
+
+        if (k != B->get_nRows())
+            throw std::invalid_argument(
+                "out_of_core_multiply(): dimension mismatch");
+
+        U tm, tk, tn;
+        if (!get_out_of_core_tiles<T>(m, k, n, memory_budget, tm, tk, tn))
+            throw std::invalid_argument(
+                "out_of_core_multiply(): memory budget too small");
+
+        std::unique_ptr<MatrixFile<T>> C(MatrixFile<T>::create(path_C, m, n));
+        if (!C)
+            return false;
+
+        // Two buffers each for A, B, and C: slot s % 2 for step s.
+        Workspace<T> ws(get_out_of_core_memory<T>(tm, tk, tn) / sizeof(T));
+        MatrixView<T> A_tiles[2], B_tiles[2], C_tiles[2];
+        for (U slot = 0; slot < 2; slot++)
+        {
+            A_tiles[slot] = ws.allocate(tm, tk);
+            B_tiles[slot] = ws.allocate(tk, tn);
+            C_tiles[slot] = ws.allocate(tm, tn);
+        }
+
+        // The steps, one per pair of A and B tiles: over the tiles of C in
+        // row-major order, and for each, over the slices of k.
+        U num_i = (m + tm - 1) / tm;
+        U num_j = (n + tn - 1) / tn;
+        U num_k = (k + tk - 1) / tk;
+        U num_steps = num_i * num_j * num_k;
+
+        struct Step { U i, j, k; };
+        auto get_step = [&](U s)
+        {
+            return Step{ s / (num_j * num_k), (s / num_k) % num_j,
+                s % num_k };
+        };
+
+        // The part of each buffer that tile [i][j] (or [i][k], or [k][j])
+        // fills: less than all of it at the bottom and right edges.
+        auto get_tile = [](MatrixView<T> buffer, U i, U j, U nr, U nc,
+            U total_rows, U total_cols)
+        {
+            return buffer.block(0, 0, std::min(nr, total_rows - i * nr),
+                std::min(nc, total_cols - j * nc));
+        };
+
+        U bytes_read = 0;
+        auto read_step = [&](U s)
+        {
+            Step st = get_step(s);
+            MatrixView<T> a = get_tile(A_tiles[s % 2], st.i, st.k, tm, tk,
+                m, k);
+            MatrixView<T> b = get_tile(B_tiles[s % 2], st.k, st.j, tk, tn,
+                k, n);
+            A->read_block(st.i * tm, st.k * tk, a);
+            B->read_block(st.k * tk, st.j * tn, b);
+            bytes_read += (a.nRows * a.nCols + b.nRows * b.nCols) * sizeof(T);
+        };
+
+        // Declared after the buffers, so that an exception waits for the
+        // pending reads and writes before the buffers go.
+        std::future<void> reading = std::async(std::launch::async,
+            read_step, 0);
+        std::future<void> writing;
+        double wait_seconds = 0;
+
+        U c_slot = 0;
+        for (U s = 0; s < num_steps; s++)
+        {
+            Step st = get_step(s);
+
+            Clock::time_point wait_start = Clock::now();
+            reading.get();
+            wait_seconds += get_seconds_since(wait_start);
+
+            if (s + 1 < num_steps)
+                reading = std::async(std::launch::async, read_step, s + 1);
+
+            MatrixView<T> a = get_tile(A_tiles[s % 2], st.i, st.k, tm, tk,
+                m, k);
+            MatrixView<T> b = get_tile(B_tiles[s % 2], st.k, st.j, tk, tn,
+                k, n);
+            MatrixView<T> c = get_tile(C_tiles[c_slot], st.i, st.j, tm, tn,
+                m, n);
+
+            if (!st.k)
+                view_set_to_zero(c);
+
+            view_multiply_add(a, b, c);
+
+            if (st.k + 1 < num_k)
+                continue;
+
+            // The previous tile of C, from the other slot, must be out
+            // before this one starts: one writer at a time.
+            if (writing.valid())
+            {
+                wait_start = Clock::now();
+                writing.get();
+                wait_seconds += get_seconds_since(wait_start);
+            }
+
+            MatrixFile<T>* file = C.get();
+            writing = std::async(std::launch::async, [file, c, st, tm, tn]()
+                { file->write_block(c, st.i * tm, st.j * tn); });
+            c_slot ^= 1;
+        }
+
+        Clock::time_point wait_start = Clock::now();
+        writing.get();
+        wait_seconds += get_seconds_since(wait_start);
+
+        C->finish();
+
+        if (stats)
+        {
+            stats->tile_rows = tm;
+            stats->tile_inner = tk;
+            stats->tile_cols = tn;
+            stats->bytes_read = bytes_read;
+            stats->bytes_written = m * n * sizeof(T);
+            stats->seconds = get_seconds_since(start);
+            stats->wait_seconds = wait_seconds;
+        }
+
+        return true;
+    }
+    catch(std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << "\n";
+        return false;
+    }
+    catch(...)
+    {
+        std::cerr << "Error: Unknown problem\n";
+        return false;
+    }
+}
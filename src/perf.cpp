@@ -0,0 +1,301 @@
+#include "perf.h"
+
+#include <chrono>
+#include <mutex>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// ----------------------------------------------------
+
+const char* get_perf_phase_name(PerfPhase phase)
+{
+    switch (phase)
+    {
+    case PerfPhase::SB_sums:        return "SB sums";
+    case PerfPhase::SB_products:    return "SB products";
+    case PerfPhase::SB_combine:     return "SB combine";
+    case PerfPhase::BB_products:    return "BB products";
+    case PerfPhase::assemble:       return "assemble";
+    case PerfPhase::Count:          break;
+    }
+
+    return "unknown";
+}
+
+static const U NUM_PHASES = static_cast<U>(PerfPhase::Count);
+
+// The counts of each phase, summed over threads and calls.
+static PerfCounts phase_counts[NUM_PHASES];
+static std::mutex phase_counts_mutex;
+
+static bool perf_trace = false;
+
+bool get_perf_trace()
+{
+    return perf_trace;
+}
+
+void set_perf_trace(bool trace)
+{
+    perf_trace = trace;
+}
+
+// ----------------------------------------------------
+
+// The events, in the order in which they are read.  The first one leads the
+// group.
+enum Event { CYCLES, INSTRUCTIONS, L1_MISSES, LLC_MISSES, DTLB_MISSES,
+    NUM_EVENTS };
+
+// One reading of the clock and the counters.
+struct Reading
+{
+    U nanoseconds = 0;
+    U events[NUM_EVENTS] = {};
+};
+
+// The counters of one thread, and its stack of open phases.
+class ThreadCounters
+{
+public:
+    ThreadCounters();
+    ~ThreadCounters();
+
+    bool is_available() const { return leader >= 0; }
+
+    // Charge the events since the last reading to the innermost open phase,
+    // if any, and then open the phase counted in `counts`, or close the
+    // innermost one.
+    void enter(PerfCounts* counts);
+    void leave();
+
+private:
+    Reading read();
+    void charge_innermost();
+
+    int leader = -1;
+    int fds[NUM_EVENTS];
+    std::vector<PerfCounts*> stack;
+    Reading last;
+};
+
+static thread_local ThreadCounters thread_counters;
+
+#ifdef __linux__
+
+static int open_event(U type, U config, int group_fd)
+{
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED
+        | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    // This thread, on any CPU.
+    return syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+static U cache_miss(U cache)
+{
+    return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+        | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+#endif
+
+ThreadCounters::ThreadCounters()
+{
+    for (int& fd : fds)
+        fd = -1;
+
+#ifdef __linux__
+    leader = fds[CYCLES] = open_event(PERF_TYPE_HARDWARE,
+        PERF_COUNT_HW_CPU_CYCLES, -1);
+    if (leader < 0)
+    {
+        DPRINTF(1)("perf_event_open() failed: no hardware counters\n");
+        return;
+    }
+
+    // Any of the others may be missing, e.g. under a hypervisor.
+    fds[INSTRUCTIONS] = open_event(PERF_TYPE_HARDWARE,
+        PERF_COUNT_HW_INSTRUCTIONS, leader);
+    fds[L1_MISSES] = open_event(PERF_TYPE_HW_CACHE,
+        cache_miss(PERF_COUNT_HW_CACHE_L1D), leader);
+    fds[LLC_MISSES] = open_event(PERF_TYPE_HARDWARE,
+        PERF_COUNT_HW_CACHE_MISSES, leader);
+    fds[DTLB_MISSES] = open_event(PERF_TYPE_HW_CACHE,
+        cache_miss(PERF_COUNT_HW_CACHE_DTLB), leader);
+#endif
+
+    last = read();
+}
+
+ThreadCounters::~ThreadCounters()
+{
+#ifdef __linux__
+    for (int fd : fds)
+        if (fd >= 0)
+            close(fd);
+#endif
+}
+
+Reading ThreadCounters::read()
+{
+    Reading r;
+    r.nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+
+#ifdef __linux__
+    if (leader < 0)
+        return r;
+
+    // nr, time enabled, time running, then one value per open event.
+    uint64_t data[3 + NUM_EVENTS];
+    if (::read(leader, data, sizeof(data)) < (ssize_t) (3 * sizeof(uint64_t)))
+        return r;
+
+    // If the group had to share the PMU with other groups, scale up to the
+    // whole time it was enabled.
+    double scale = data[2] ? (double) data[1] / data[2] : 0;
+
+    U value = 3;
+    for (U e = 0; e < NUM_EVENTS; e++)
+        if (fds[e] >= 0)
+            r.events[e] = (U) (data[value++] * scale);
+#endif
+
+    return r;
+}
+
+// Return b - a, or 0 if scaling made it negative.
+static U get_delta(U a, U b)
+{
+    return (b > a) ? b - a : 0;
+}
+
+void ThreadCounters::charge_innermost()
+{
+    Reading now = read();
+
+    if (!stack.empty())
+    {
+        PerfCounts& c = *stack.back();
+        c.nanoseconds += get_delta(last.nanoseconds, now.nanoseconds);
+        c.cycles += get_delta(last.events[CYCLES], now.events[CYCLES]);
+        c.instructions += get_delta(last.events[INSTRUCTIONS],
+            now.events[INSTRUCTIONS]);
+        c.L1_misses += get_delta(last.events[L1_MISSES],
+            now.events[L1_MISSES]);
+        c.LLC_misses += get_delta(last.events[LLC_MISSES],
+            now.events[LLC_MISSES]);
+        c.dTLB_misses += get_delta(last.events[DTLB_MISSES],
+            now.events[DTLB_MISSES]);
+    }
+
+    last = now;
+}
+
+void ThreadCounters::enter(PerfCounts* counts)
+{
+    charge_innermost();
+    stack.push_back(counts);
+}
+
+void ThreadCounters::leave()
+{
+    charge_innermost();
+    stack.pop_back();
+}
+
+// ----------------------------------------------------
+
+static void add_counts(PerfCounts& sum, const PerfCounts& c)
+{
+    sum.calls += c.calls;
+    sum.nanoseconds += c.nanoseconds;
+    sum.cycles += c.cycles;
+    sum.instructions += c.instructions;
+    sum.L1_misses += c.L1_misses;
+    sum.LLC_misses += c.LLC_misses;
+    sum.dTLB_misses += c.dTLB_misses;
+}
+
+// Print one row of counts, divided by `calls`.
+static void print_counts(const char* label, const PerfCounts& c, U calls)
+{
+    double d = calls;
+    printf("%-12s %8zu %12.3f %14.0f %14.0f %6.2f %12.0f %12.0f %12.0f\n",
+        label, c.calls, c.nanoseconds / d / 1e6, c.cycles / d,
+        c.instructions / d,
+        c.cycles ? (double) c.instructions / c.cycles : 0.0,
+        c.L1_misses / d, c.LLC_misses / d, c.dTLB_misses / d);
+}
+
+PerfScope::PerfScope(PerfPhase phase) :
+    phase(phase)
+{
+    counts.calls = 1;
+    thread_counters.enter(&counts);
+}
+
+PerfScope::~PerfScope()
+{
+    thread_counters.leave();
+
+    {
+        std::lock_guard<std::mutex> lock(phase_counts_mutex);
+        add_counts(phase_counts[static_cast<U>(phase)], counts);
+    }
+
+    if (perf_trace)
+        print_counts(get_perf_phase_name(phase), counts, 1);
+}
+
+bool is_perf_available()
+{
+    return thread_counters.is_available();
+}
+
+PerfCounts get_perf_counts(PerfPhase phase)
+{
+    std::lock_guard<std::mutex> lock(phase_counts_mutex);
+    return phase_counts[static_cast<U>(phase)];
+}
+
+void reset_perf_counts()
+{
+    std::lock_guard<std::mutex> lock(phase_counts_mutex);
+    for (auto& c : phase_counts)
+        c = PerfCounts();
+}
+
+void print_perf_report()
+{
+    printf("Performance counters (%s):\n",
+        is_perf_available() ? "exclusive of nested phases"
+            : "unavailable; times only");
+    printf("%-12s %8s %12s %14s %14s %6s %12s %12s %12s\n", "phase",
+        "calls", "time (ms)", "cycles", "instructions", "IPC", "L1D misses",
+        "LLC misses", "dTLB misses");
+
+    for (U p = 0; p < NUM_PHASES; p++)
+    {
+        PerfCounts c = get_perf_counts(static_cast<PerfPhase>(p));
+        if (!c.calls)
+            continue;
+
+        print_counts(get_perf_phase_name(static_cast<PerfPhase>(p)), c, 1);
+        print_counts("  per call", c, c.calls);
+    }
+
+    printf("----\n");
+}
@@ -0,0 +1,187 @@
+#include "random.h"
+#include "simd.h"
+#include "thread_pool.h"
+
+#include <atomic>
+
+// Explicit template instantiation.  (See matrix.cpp for details.)
+template void view_set_to_random(MatrixView<int> C, int lower, int upper,
+    U seed);
+template void view_set_to_random(MatrixView<double> C, int lower, int upper,
+    U seed);
+
+// ----------------------------------------------------
+
+// Philox4x32 constants: the multipliers, and the Weyl sequence that bumps
+// the key between rounds.
+static const uint32_t PHILOX_M0 = 0xD2511F53;
+static const uint32_t PHILOX_M1 = 0xCD9E8D57;
+static const uint32_t PHILOX_W0 = 0x9E3779B9;
+static const uint32_t PHILOX_W1 = 0xBB67AE85;
+
+static const int PHILOX_ROUNDS = 10;
+
+// The ten rounds, on one block, in place.  Inlined into the batch loop below,
+// which the compiler vectorizes across blocks.
+static inline void philox_rounds(uint32_t& x0, uint32_t& x1, uint32_t& x2,
+    uint32_t& x3, uint32_t k0, uint32_t k1)
+{
+    for (int r = 0; r < PHILOX_ROUNDS; r++)
+    {
+        uint64_t p0 = (uint64_t) PHILOX_M0 * x0;
+        uint64_t p1 = (uint64_t) PHILOX_M1 * x2;
+
+        uint32_t y0 = (uint32_t) (p1 >> 32) ^ x1 ^ k0;
+        uint32_t y1 = (uint32_t) p1;
+        uint32_t y2 = (uint32_t) (p0 >> 32) ^ x3 ^ k1;
+        uint32_t y3 = (uint32_t) p0;
+
+        x0 = y0; x1 = y1; x2 = y2; x3 = y3;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+}
+
+std::array<uint32_t, 4> philox4x32(std::array<uint32_t, 4> counter,
+    std::array<uint32_t, 2> key)
+{
+    philox_rounds(counter[0], counter[1], counter[2], counter[3],
+        key[0], key[1]);
+    return counter;
+}
+
+// Blocks per batch: enough for the vectorized loop to run at full width,
+// few enough for the output to stay in L1.
+static const U BATCH = 64;
+
+// out[4 * b .. 4 * b + 3] = block (first + b), for b in [0, n).
+// Vectorized across blocks, once per instruction set.  (See simd.h.)
+SIMD_CLONES
+static void philox_batch(uint64_t first, U n, uint64_t key, uint32_t* out)
+{
+    uint32_t k0 = (uint32_t) key;
+    uint32_t k1 = (uint32_t) (key >> 32);
+
+    for (U b = 0; b < n; b++)
+    {
+        uint64_t c = first + b;
+        uint32_t x0 = (uint32_t) c;
+        uint32_t x1 = (uint32_t) (c >> 32);
+        uint32_t x2 = 0;
+        uint32_t x3 = 0;
+
+        philox_rounds(x0, x1, x2, x3, k0, k1);
+
+        out[4 * b] = x0;
+        out[4 * b + 1] = x1;
+        out[4 * b + 2] = x2;
+        out[4 * b + 3] = x3;
+    }
+}
+
+// ----------------------------------------------------
+
+// The 32-bit words of random data per element.
+template<typename T> constexpr U get_words_per_element();
+template<> constexpr U get_words_per_element<int>()    { return 1; }
+template<> constexpr U get_words_per_element<double>() { return 2; }
+
+// Map one element's words to [lower, upper] (int) or [lower, upper) (double).
+//
+// For ints, the 32-bit word is scaled to the range, by taking the high half
+// of word * range: the bias is below range / 2**32, which is negligible for
+// the small ranges used here.  For doubles, two words give the 53 bits of a
+// uniform value in [0, 1).
+template<typename T>
+static inline T to_element(const uint32_t* words, int lower, int upper);
+
+template<>
+inline int to_element<int>(const uint32_t* words, int lower, int upper)
+{
+    uint64_t range = (uint64_t) ((int64_t) upper - lower + 1);
+    return (int) (lower + (int64_t) ((words[0] * range) >> 32));
+}
+
+template<>
+inline double to_element<double>(const uint32_t* words, int lower, int upper)
+{
+    uint64_t bits = (((uint64_t) words[0] << 32) | words[1]) >> 11;
+    return lower + (bits * 0x1.0p-53) * ((double) upper - lower);
+}
+
+// Fill elements [first, first + n) of the sequence into `row`.
+template<typename T>
+static void fill_row(T* row, U first, U n, int lower, int upper, U seed)
+{
+    const U words = get_words_per_element<T>();
+    const U per_block = 4 / words;
+
+    uint32_t buffer[4 * BATCH];
+
+    U end = first + n;
+    U block = first / per_block;
+    U e = first;
+
+    while (e < end)
+    {
+        U end_block = (end + per_block - 1) / per_block;
+        U num_blocks = std::min(BATCH, end_block - block);
+        philox_batch(block, num_blocks, seed, buffer);
+
+        U batch_end = std::min(end, (block + num_blocks) * per_block);
+        for (; e < batch_end; e++)
+            *row++ = to_element<T>(buffer + (e - block * per_block) * words,
+                lower, upper);
+
+        block += num_blocks;
+    }
+}
+
+// Below this many elements, fill on the calling thread.
+static const U MIN_PARALLEL_ELEMENTS = 1 << 16;
+
+template<typename T>
+void view_set_to_random(MatrixView<T> C, int lower, int upper, U seed)
+{
+    assert(lower <= upper);
+
+    U m = C.nRows;
+    U n = C.nCols;
+
+    auto fill_rows = [&](U begin, U end)
+    {
+        for (U i = begin; i < end; i++)
+            fill_row(C.row(i), i * n, n, lower, upper, seed);
+    };
+
+    if ((m * n < MIN_PARALLEL_ELEMENTS) || (get_num_threads() == 1))
+    {
+        fill_rows(0, m);
+        return;
+    }
+
+    U num_tiles = std::min(m, 4 * get_num_threads());
+    parallel_for(num_tiles, [&](U tile)
+    {
+        fill_rows(m * tile / num_tiles, m * (tile + 1) / num_tiles);
+    });
+}
+
+// ----------------------------------------------------
+
+static std::atomic<U> next_random_seed(0);
+
+U get_random_seed()
+{
+    return next_random_seed;
+}
+
+void set_random_seed(U seed)
+{
+    next_random_seed = seed;
+}
+
+U get_next_random_seed()
+{
+    return next_random_seed++;
+}
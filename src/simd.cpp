@@ -0,0 +1,84 @@
+#include "simd.h"
+
+// ----------------------------------------------------
+
+static ISA detect_best_ISA()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+
+    // __builtin_cpu_supports() also checks that the OS saves the wider
+    // registers on context switches (via XGETBV).
+    if (__builtin_cpu_supports("avx512f"))
+        return ISA::AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return ISA::AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return ISA::SSE2;
+#endif
+
+    return ISA::SCALAR;
+}
+
+ISA get_best_ISA()
+{
+    static const ISA best = detect_best_ISA();
+    return best;
+}
+
+const char* get_ISA_name(ISA isa)
+{
+    switch (isa)
+    {
+        case ISA::SCALAR: return "scalar";
+        case ISA::SSE2:   return "SSE2";
+        case ISA::AVX2:   return "AVX2";
+        case ISA::AVX512: return "AVX-512";
+    }
+
+    return "{unknown ISA}";
+}
+
+// ----------------------------------------------------
+
+SIMD_CLONES
+void vector_add(U n, const int* a, const int* b, int* c)
+{
+    for (U i = 0; i < n; i++)
+        c[i] = a[i] + b[i];
+}
+
+SIMD_CLONES
+void vector_add(U n, const double* a, const double* b, double* c)
+{
+    for (U i = 0; i < n; i++)
+        c[i] = a[i] + b[i];
+}
+
+SIMD_CLONES
+void vector_sub(U n, const int* a, const int* b, int* c)
+{
+    for (U i = 0; i < n; i++)
+        c[i] = a[i] - b[i];
+}
+
+SIMD_CLONES
+void vector_sub(U n, const double* a, const double* b, double* c)
+{
+    for (U i = 0; i < n; i++)
+        c[i] = a[i] - b[i];
+}
+
+SIMD_CLONES
+void vector_negate(U n, const int* a, int* c)
+{
+    for (U i = 0; i < n; i++)
+        c[i] = -a[i];
+}
+
+SIMD_CLONES
+void vector_negate(U n, const double* a, double* c)
+{
+    for (U i = 0; i < n; i++)
+        c[i] = -a[i];
+}
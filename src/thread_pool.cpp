@@ -0,0 +1,279 @@
+#include "thread_pool.h"
+#include "numa.h"
+
+#include <algorithm>
+
+// Identity of the calling thread, if it is a worker: which pool, and which
+// of its queues is its own.
+static thread_local const ThreadPool* this_thread_pool = nullptr;
+static thread_local U this_thread_id = 0;
+
+// How many tasks the calling thread is currently running (nested, when a
+// task waits for a TaskGroup and runs other tasks meanwhile).
+static thread_local U this_thread_task_depth = 0;
+
+static void run_task(Task& task)
+{
+    this_thread_task_depth++;
+    task();
+    this_thread_task_depth--;
+}
+
+bool in_parallel_task()
+{
+    return (this_thread_task_depth > 0);
+}
+
+// ----------------------------------------------------
+
+ThreadPool::ThreadPool(U num_threads)
+    : num_workers(num_threads ? (num_threads - 1) : 0),
+      num_queued(0),
+      stopping(false)
+{
+    for (U i = 0; i <= num_workers; i++)
+        queues.push_back(std::unique_ptr<TaskQueue>(new TaskQueue));
+
+    for (U i = 0; i < num_workers; i++)
+        workers.push_back(std::thread(&ThreadPool::worker_loop, this, i));
+
+    // The creating thread is slot 0 (see numa.h).
+    if (get_thread_cpu(0) >= 0)
+        pin_this_thread(get_thread_cpu(0));
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(sleep_lock);
+        stopping = true;
+    }
+    wake_up.notify_all();
+
+    for (auto& worker : workers)
+        worker.join();
+}
+
+void ThreadPool::submit(Task task)
+{
+    // Workers push onto their own queue; everybody else uses the injection
+    // queue.
+    U id = (this_thread_pool == this) ? this_thread_id : num_workers;
+
+    {
+        std::lock_guard<std::mutex> guard(queues[id]->lock);
+        queues[id]->tasks.push_back(std::move(task));
+    }
+
+    num_queued++;
+
+    // Taking the lock orders this notification after any worker's check of
+    // `num_queued`, so the wake-up cannot be lost.
+    {
+        std::lock_guard<std::mutex> guard(sleep_lock);
+    }
+    wake_up.notify_one();
+}
+
+void ThreadPool::submit_to(U worker, Task task)
+{
+    assert(worker < num_workers);
+
+    {
+        std::lock_guard<std::mutex> guard(queues[worker]->lock);
+        queues[worker]->pinned_tasks.push_back(std::move(task));
+        queues[worker]->num_pinned++;
+    }
+
+    // Only `worker` can run it, so wake everybody, to be sure to wake it.
+    {
+        std::lock_guard<std::mutex> guard(sleep_lock);
+    }
+    wake_up.notify_all();
+}
+
+bool ThreadPool::find_task(U id, Task& task)
+{
+    // Tasks pinned to us (workers only).
+    if ((id < num_workers) && queues[id]->num_pinned)
+    {
+        TaskQueue& queue = *queues[id];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        task = std::move(queue.pinned_tasks.front());
+        queue.pinned_tasks.pop_front();
+        queue.num_pinned--;
+        return true;
+    }
+
+    if (!num_queued)
+        return false;
+
+    // Our own queue: newest task first.
+    {
+        TaskQueue& queue = *queues[id];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (!queue.tasks.empty())
+        {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            num_queued--;
+            return true;
+        }
+    }
+
+    // Somebody else's queue: oldest task first.
+    for (U i = 1; i <= num_workers; i++)
+    {
+        TaskQueue& queue = *queues[(id + i) % (num_workers + 1)];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (!queue.tasks.empty())
+        {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            num_queued--;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool ThreadPool::run_one()
+{
+    U id = (this_thread_pool == this) ? this_thread_id : num_workers;
+
+    Task task;
+    if (!find_task(id, task))
+        return false;
+
+    run_task(task);
+    return true;
+}
+
+void ThreadPool::worker_loop(U id)
+{
+    this_thread_pool = this;
+    this_thread_id = id;
+
+    pin_this_thread(get_thread_cpu(id + 1));
+
+    while (true)
+    {
+        Task task;
+        if (find_task(id, task))
+        {
+            run_task(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> guard(sleep_lock);
+        wake_up.wait(guard, [this, id] {
+            return stopping || (num_queued > 0) || (queues[id]->num_pinned > 0);
+        });
+
+        if (stopping && !num_queued && !queues[id]->num_pinned)
+            return;
+    }
+}
+
+// ----------------------------------------------------
+
+static std::mutex pool_lock;
+static std::unique_ptr<ThreadPool> pool;
+static U num_threads = std::max(1U, std::thread::hardware_concurrency());
+
+ThreadPool& get_thread_pool()
+{
+    std::lock_guard<std::mutex> guard(pool_lock);
+
+    if (!pool)
+        pool.reset(new ThreadPool(num_threads));
+
+    return *pool;
+}
+
+U get_num_threads()
+{
+    return num_threads;
+}
+
+void set_num_threads(U n)
+{
+    assert(n >= 1);
+
+    std::lock_guard<std::mutex> guard(pool_lock);
+
+    num_threads = n;
+    pool.reset(new ThreadPool(num_threads));
+}
+
+// ----------------------------------------------------
+
+void TaskGroup::wait()
+{
+    finish();
+
+    std::exception_ptr e;
+    {
+        std::lock_guard<std::mutex> guard(error_lock);
+        std::swap(e, error);
+    }
+
+    if (e)
+        std::rethrow_exception(e);
+}
+
+void TaskGroup::finish()
+{
+    if (!num_pending)
+        return;
+
+    ThreadPool& pool = get_thread_pool();
+
+    while (num_pending)
+    {
+        if (!pool.run_one())
+            std::this_thread::yield();
+    }
+}
+
+// ----------------------------------------------------
+
+void parallel_for(U n, const std::function<void(U)>& body)
+{
+    TaskGroup group;
+
+    for (U i = 0; i < n; i++)
+        group.run([&body, i] { body(i); });
+
+    group.wait();
+}
+
+void parallel_for_each_thread(const std::function<void(U, U)>& body)
+{
+    ThreadPool& pool = get_thread_pool();
+    U num_slots = pool.get_num_threads();
+
+    if (in_parallel_task() || (num_slots == 1))
+    {
+        parallel_for(num_slots, [&](U slot) { body(slot, num_slots); });
+        return;
+    }
+
+    std::atomic<U> num_pending(num_slots - 1);
+
+    for (U slot = 1; slot < num_slots; slot++)
+        pool.submit_to(slot - 1, [&, slot] {
+            body(slot, num_slots);
+            num_pending--;
+        });
+
+    Task own_slot = [&] { body(0, num_slots); };
+    run_task(own_slot);
+
+    while (num_pending)
+    {
+        if (!pool.run_one())
+            std::this_thread::yield();
+    }
+}
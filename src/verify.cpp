@@ -0,0 +1,179 @@
+#include "verify.h"
+#include "random.h"
+#include "thread_pool.h"
+
+#include <cmath>
+#include <type_traits>
+
+// Explicit template instantiation.  (See matrix.cpp for details.)
+#define INSTANTIATE_VERIFY(T)                                               \
+    template bool view_verify_product(MatrixView<T> A, MatrixView<T> B,     \
+        MatrixView<T> C, U rounds, double tolerance);                       \
+    template bool view_verify_product(MatrixView<T> A, MatrixView<T> B,     \
+        MatrixView<T> C);                                                   \
+    template bool verify_product(const Matrix<T>* A, const Matrix<T>* B,    \
+        const Matrix<T>* C);
+
+INSTANTIATE_VERIFY(int)
+INSTANTIATE_VERIFY(double)
+
+// ----------------------------------------------------
+
+static U verify_rounds = 20;
+
+U get_verify_rounds()
+{
+    return verify_rounds;
+}
+
+void set_verify_rounds(U n)
+{
+    assert(n >= 1);
+    verify_rounds = n;
+}
+
+static double verify_tolerance = 1e-10;
+
+double get_verify_tolerance()
+{
+    return verify_tolerance;
+}
+
+void set_verify_tolerance(double tolerance)
+{
+    assert(tolerance >= 0);
+    verify_tolerance = tolerance;
+}
+
+// ----------------------------------------------------
+
+// The type in which the projections are accumulated: exact for ints.
+template<typename T>
+using Accumulator = typename std::conditional<std::is_integral<T>::value,
+    int64_t, double>::type;
+
+// Below this many elements, work on the calling thread.
+static const U MIN_PARALLEL_ELEMENTS = 1 << 16;
+
+// Y = M * X, where X has M.nCols rows of R elements, and Y has M.nRows.
+// If w is not null, also w = |M| * u, or |M| * 1 if u is null.
+template<typename T, typename Acc>
+static void multiply_rows(MatrixView<T> M, const Acc* X, U R, Acc* Y,
+    const double* u, double* w)
+{
+    auto rows = [&](U begin, U end)
+    {
+        for (U i = begin; i < end; i++)
+        {
+            const T* row = M.row(i);
+            Acc* y = Y + i * R;
+            double s = 0;
+
+            for (U r = 0; r < R; r++)
+                y[r] = 0;
+
+            for (U j = 0; j < M.nCols; j++)
+            {
+                Acc a = row[j];
+                const Acc* x = X + j * R;
+
+                for (U r = 0; r < R; r++)
+                    y[r] += a * x[r];
+
+                if (w)
+                    s += std::abs((double) row[j]) * (u ? u[j] : 1.0);
+            }
+
+            if (w)
+                w[i] = s;
+        }
+    };
+
+    U m = M.nRows;
+
+    if ((m * M.nCols < MIN_PARALLEL_ELEMENTS) || (get_num_threads() == 1))
+    {
+        rows(0, m);
+        return;
+    }
+
+    U num_tiles = std::min(m, 4 * get_num_threads());
+    parallel_for(num_tiles, [&](U tile)
+    {
+        rows(m * tile / num_tiles, m * (tile + 1) / num_tiles);
+    });
+}
+
+template<typename T>
+bool view_verify_product(MatrixView<T> A, MatrixView<T> B, MatrixView<T> C,
+    U rounds, double tolerance)
+{
+    using Acc = Accumulator<T>;
+    const bool exact = std::is_integral<T>::value;
+
+    U m = A.nRows;
+    U k = A.nCols;
+    U n = B.nCols;
+    U R = rounds;
+
+    if ((k != B.nRows) || (m != C.nRows) || (n != C.nCols))
+        return false;
+
+    // The random signs: R columns, one per round.
+    std::vector<int> bits(n * R);
+    view_set_to_random(MatrixView<int>{ bits.data(), n, R, R }, 0, 1,
+        get_next_random_seed());
+
+    std::vector<Acc> signs(n * R);
+    for (U i = 0; i < n * R; i++)
+        signs[i] = bits[i] ? 1 : -1;
+
+    // X = B * r; Y = A * X; Z = C * r.  And, for the bounds, u = |B| * 1,
+    // and s = |A| * u.
+    std::vector<Acc> X(k * R), Y(m * R), Z(m * R);
+    std::vector<double> u, s;
+    if (!exact)
+    {
+        u.resize(k);
+        s.resize(m);
+    }
+
+    multiply_rows(B, signs.data(), R, X.data(), nullptr,
+        exact ? nullptr : u.data());
+    multiply_rows(A, X.data(), R, Y.data(), exact ? nullptr : u.data(),
+        exact ? nullptr : s.data());
+    multiply_rows(C, signs.data(), R, Z.data(), nullptr, nullptr);
+
+    for (U i = 0; i < m; i++)
+    {
+        double bound = exact ? 0 : tolerance * s[i];
+
+        for (U r = 0; r < R; r++)
+        {
+            // Written so that a NaN fails.
+            double error = std::abs((double) (Y[i * R + r] - Z[i * R + r]));
+            if (!(error <= bound))
+            {
+                DPRINTF(1)("verify_product(): row %zu, round %zu: error %g,"
+                    " bound %g\n", i, r, error, bound);
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+template<typename T>
+bool view_verify_product(MatrixView<T> A, MatrixView<T> B, MatrixView<T> C)
+{
+    return view_verify_product(A, B, C, get_verify_rounds(),
+        get_verify_tolerance());
+}
+
+template<typename T>
+bool verify_product(const Matrix<T>* A, const Matrix<T>* B,
+    const Matrix<T>* C)
+{
+    return view_verify_product(A->view(), B->view(), C->view());
+}
@@ -0,0 +1,66 @@
+#include "workspace.h"
+#include "allocation.h"
+
+// Explicit template instantiation.  (See matrix.cpp for details.)
+template class Workspace<int>;
+template class Workspace<double>;
+
+// ----------------------------------------------------
+
+// Number of elements in one 64-byte cache line.
+template<typename T>
+static U elements_per_line()
+{
+    return 64 / sizeof(T);
+}
+
+template<typename T>
+Workspace<T>::Workspace(U n)
+    : buffer(allocate_aligned<T>(n)), capacity(n), used(0), peak(0),
+      owns_buffer(true)
+{
+}
+
+template<typename T>
+Workspace<T>::Workspace(T* buffer, U n)
+    : buffer(buffer), capacity(n), used(0), peak(0), owns_buffer(false)
+{
+}
+
+template<typename T>
+Workspace<T>::~Workspace()
+{
+    if (owns_buffer)
+        free_aligned(buffer, capacity);
+}
+
+// ----------------------------------------------------
+
+template<typename T>
+U Workspace<T>::get_allocation_size(U nr, U nc)
+{
+    U line = elements_per_line<T>();
+    return ((nr * get_padded_ld<T>(nc) + line - 1) / line) * line;
+}
+
+template<typename T>
+T* Workspace<T>::allocate_raw(U n)
+{
+    assert(!(n % elements_per_line<T>()));
+
+    // Running out means the caller's size calculation does not match its
+    // allocations: a bug, not a recoverable condition.
+    assert(n <= capacity - used);
+
+    T* p = buffer + used;
+    used += n;
+    peak = std::max(peak, used);
+    return p;
+}
+
+template<typename T>
+MatrixView<T> Workspace<T>::allocate(U nr, U nc)
+{
+    T* p = allocate_raw(get_allocation_size(nr, nc));
+    return { p, nr, nc, get_padded_ld<T>(nc) };
+}